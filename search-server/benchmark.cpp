@@ -0,0 +1,562 @@
+#include "benchmark.h"
+#include "search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "document_ingestion.h"
+#include "impact_index.h"
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Every DUPLICATE_PERIOD-th document repeats the text of the previous one
+const size_t DUPLICATE_PERIOD = 100;
+// Every REMOVE_PERIOD-th document is removed by the RemoveDocument benchmarks
+const size_t REMOVE_PERIOD = 100;
+// Every UPDATE_PERIOD-th remaining document is changed by the UpdateDocument benchmarks
+const size_t UPDATE_PERIOD = 10;
+
+const int SHORT_QUERY_WORD_COUNT = 3;
+const int LONG_QUERY_WORD_COUNT = 30;
+const int MINUS_QUERY_WORD_COUNT = 10;
+const double MINUS_QUERY_MINUS_PROB = 0.5;
+// Documents per MatchDocuments call
+const size_t MATCH_BATCH_SIZE = 100;
+// Postings a budgeted ImpactIndex query may score
+const size_t IMPACT_POSTINGS_BUDGET = 1000;
+
+// Uniform in [0, 1) from the raw engine output, which unlike the standard
+// distributions is the same on every platform
+double GenerateUnit(std::mt19937& generator) {
+    return generator() / 4294967296.0;
+}
+
+double GetSeconds(Clock::time_point start_time) {
+    return std::chrono::duration<double>(Clock::now() - start_time).count();
+}
+
+// Calls function(i) for every i in [0, task_count), spreading the calls
+// evenly over thread_count threads
+template <typename Function>
+void RunOnThreads(size_t thread_count, size_t task_count, Function function) {
+    if (thread_count <= 1) {
+        for (size_t i = 0; i < task_count; ++i) {
+            function(i);
+        }
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t thread_index = 0; thread_index < thread_count; ++thread_index) {
+        threads.emplace_back([=, &function] {
+            for (size_t i = thread_index; i < task_count; i += thread_count) {
+                function(i);
+            }
+            });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Task results are summed in task order, so the checksum does not depend
+// on the thread count
+template <typename Function>
+double SumOnThreads(size_t thread_count, size_t task_count, Function function) {
+    std::vector<double> sums(task_count);
+    RunOnThreads(thread_count, task_count, [&](size_t i) {
+        sums[i] = function(i);
+        });
+    return std::accumulate(sums.begin(), sums.end(), 0.0);
+}
+
+double SumRelevance(const std::vector<Document>& documents) {
+    double sum = 0.0;
+    for (const Document& document : documents) {
+        sum += document.relevance;
+    }
+    return sum;
+}
+
+// Generator of the inputs of one benchmark. Every benchmark has its own
+// stream, so adding or reordering benchmarks leaves the inputs and
+// checksums of the others unchanged.
+std::mt19937 MakeGenerator(uint32_t seed, const std::string& name, size_t corpus_size) {
+    // FNV-1a, unlike std::hash, is the same on every platform
+    uint32_t name_hash = 2166136261u;
+    for (const char c : name) {
+        name_hash = (name_hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    std::seed_seq seed_sequence{ seed, name_hash, static_cast<uint32_t>(corpus_size) };
+    return std::mt19937(seed_sequence);
+}
+
+std::vector<int> GenerateRatings(std::mt19937& generator) {
+    std::vector<int> ratings(1 + generator() % 5);
+    for (int& rating : ratings) {
+        rating = static_cast<int>(generator() % 21) - 10;
+    }
+    return ratings;
+}
+
+struct Corpus {
+    std::vector<std::string> texts;
+    std::vector<std::vector<int>> ratings;
+};
+
+// Reads the corpus as a TSV dump, formatting one line at a time, so the
+// dump is never held in memory next to the corpus
+class CorpusTsvBuffer : public std::streambuf {
+public:
+    explicit CorpusTsvBuffer(const Corpus& corpus)
+        : corpus_(corpus) {
+    }
+
+protected:
+    int_type underflow() override {
+        if (next_document_ == corpus_.texts.size()) {
+            return traits_type::eof();
+        }
+        line_ = std::to_string(next_document_) + "\tACTUAL\t"s;
+        const std::vector<int>& ratings = corpus_.ratings[next_document_];
+        for (size_t j = 0; j < ratings.size(); ++j) {
+            line_ += (j == 0 ? ""s : " "s) + std::to_string(ratings[j]);
+        }
+        line_ += '\t';
+        line_ += corpus_.texts[next_document_];
+        line_ += '\n';
+        ++next_document_;
+        setg(line_.data(), line_.data(), line_.data() + line_.size());
+        return traits_type::to_int_type(line_.front());
+    }
+
+private:
+    const Corpus& corpus_;
+    size_t next_document_ = 0;
+    std::string line_;
+};
+
+class BenchmarkRunner {
+public:
+    BenchmarkRunner(const BenchmarkConfig& config, size_t corpus_size)
+        : config_(config)
+        , corpus_size_(corpus_size)
+        , generator_(config.seed)
+        , dictionary_(GenerateDictionary(generator_, config.dictionary_size, config.max_word_length))
+        , distribution_(dictionary_.size(), config.zipf_exponent) {
+    }
+
+    std::vector<BenchmarkResult> Run() {
+        GenerateCorpus();
+        RunIngestion();
+
+        // The most frequent word is the stop word
+        SearchServer search_server(dictionary_[0]);
+        RunAddDocument(search_server);
+        RunFindTopDocuments(search_server);
+        RunMatchDocument(search_server);
+        RunProcessQueries(search_server);
+        RunImpactIndex(search_server);
+        RunRemoveDocument(search_server);
+        RunRemoveDuplicates(search_server);
+        RunUpdateDocument(search_server);
+        return std::move(results_);
+    }
+
+private:
+    const BenchmarkConfig& config_;
+    const size_t corpus_size_;
+    // Dictionary and corpus; benchmark inputs come from MakeGenerator
+    std::mt19937 generator_;
+    const std::vector<std::string> dictionary_;
+    const ZipfDistribution distribution_;
+    Corpus corpus_;
+    std::vector<BenchmarkResult> results_;
+
+    void AddResult(const std::string& name, size_t thread_count, size_t operation_count, double seconds, double checksum) {
+        results_.push_back({ name, corpus_size_, thread_count, operation_count, seconds, checksum });
+    }
+
+    std::mt19937 MakeGenerator(const std::string& name) const {
+        return ::MakeGenerator(config_.seed, name, corpus_size_);
+    }
+
+    std::vector<std::string> GenerateQueries(std::mt19937& generator, int word_count, double minus_prob = 0) {
+        return ::GenerateQueries(generator, dictionary_, distribution_, config_.query_count, word_count, minus_prob);
+    }
+
+    std::vector<std::string> GenerateQueries(const std::string& name, int word_count, double minus_prob = 0) {
+        std::mt19937 generator = MakeGenerator(name);
+        return GenerateQueries(generator, word_count, minus_prob);
+    }
+
+    void GenerateCorpus() {
+        corpus_.texts.reserve(corpus_size_);
+        corpus_.ratings.reserve(corpus_size_);
+        for (size_t i = 0; i < corpus_size_; ++i) {
+            if (i % DUPLICATE_PERIOD == DUPLICATE_PERIOD - 1) {
+                corpus_.texts.push_back(corpus_.texts.back());
+            }
+            else {
+                corpus_.texts.push_back(GenerateQuery(generator_, dictionary_, distribution_, config_.document_word_count));
+            }
+            corpus_.ratings.push_back(GenerateRatings(generator_));
+        }
+    }
+
+    void RunIngestion() {
+        CorpusTsvBuffer tsv(corpus_);
+        std::istream input(&tsv);
+        SearchServer search_server(dictionary_[0]);
+        const IngestionStats stats = IngestDocuments(search_server, input, InputFormat::TSV);
+        // Reader, parser, tokenizer and indexer threads
+        AddResult("ingest_tsv"s, 4, stats.document_count, stats.seconds, static_cast<double>(search_server.GetDocumentCount()));
+    }
+
+    void RunAddDocument(SearchServer& search_server) {
+        const Clock::time_point start_time = Clock::now();
+        for (size_t i = 0; i < corpus_.texts.size(); ++i) {
+            search_server.AddDocument(static_cast<int>(i), corpus_.texts[i], DocumentStatus::ACTUAL, corpus_.ratings[i]);
+        }
+        AddResult("add_document"s, 1, corpus_.texts.size(), GetSeconds(start_time), static_cast<double>(search_server.GetDocumentCount()));
+        corpus_ = Corpus();
+    }
+
+    template <typename DocumentPredicate>
+    void RunFindTopDocuments(const SearchServer& search_server, const std::string& name,
+        const std::vector<std::string>& queries, DocumentPredicate document_predicate) {
+        for (const size_t thread_count : config_.thread_counts) {
+            const Clock::time_point start_time = Clock::now();
+            const double checksum = SumOnThreads(thread_count, queries.size(), [&](size_t i) {
+                return SumRelevance(search_server.FindTopDocuments(std::execution::seq, queries[i], document_predicate));
+                });
+            AddResult(name + "_seq"s, thread_count, queries.size(), GetSeconds(start_time), checksum);
+        }
+
+        const Clock::time_point start_time = Clock::now();
+        double checksum = 0.0;
+        for (const std::string& query : queries) {
+            checksum += SumRelevance(search_server.FindTopDocuments(std::execution::par, query, document_predicate));
+        }
+        AddResult(name + "_par"s, 0, queries.size(), GetSeconds(start_time), checksum);
+    }
+
+    void RunFindTopDocuments(const SearchServer& search_server) {
+        const auto actual = [](int document_id, DocumentStatus status, int rating) {
+            return status == DocumentStatus::ACTUAL;
+        };
+        const auto filtered = [](int document_id, DocumentStatus status, int rating) {
+            return document_id % 2 == 0 && rating > 0;
+        };
+        RunFindTopDocuments(search_server, "find_top_short"s, GenerateQueries("find_top_short"s, SHORT_QUERY_WORD_COUNT), actual);
+        RunFindTopDocuments(search_server, "find_top_long"s, GenerateQueries("find_top_long"s, LONG_QUERY_WORD_COUNT), actual);
+        RunFindTopDocuments(search_server, "find_top_minus"s,
+            GenerateQueries("find_top_minus"s, MINUS_QUERY_WORD_COUNT, MINUS_QUERY_MINUS_PROB), actual);
+        RunFindTopDocuments(search_server, "find_top_filtered"s, GenerateQueries("find_top_filtered"s, SHORT_QUERY_WORD_COUNT), filtered);
+    }
+
+    void RunMatchDocument(const SearchServer& search_server) {
+        std::mt19937 generator = MakeGenerator("match_document"s);
+        const std::vector<std::string> queries = GenerateQueries(generator, MINUS_QUERY_WORD_COUNT, MINUS_QUERY_MINUS_PROB);
+        std::vector<int> document_ids(queries.size());
+        for (int& document_id : document_ids) {
+            document_id = static_cast<int>(generator() % search_server.GetDocumentCount());
+        }
+        for (const size_t thread_count : config_.thread_counts) {
+            const Clock::time_point start_time = Clock::now();
+            const double checksum = SumOnThreads(thread_count, queries.size(), [&](size_t i) {
+                const auto [words, status] = search_server.MatchDocument(queries[i], document_ids[i]);
+                return static_cast<double>(words.size());
+                });
+            AddResult("match_document_seq"s, thread_count, queries.size(), GetSeconds(start_time), checksum);
+        }
+
+        // A result page highlighting the query words in every hit
+        std::mt19937 batch_generator = MakeGenerator("match_documents_batch"s);
+        std::vector<int> page_ids(MATCH_BATCH_SIZE);
+        for (int& document_id : page_ids) {
+            document_id = static_cast<int>(batch_generator() % search_server.GetDocumentCount());
+        }
+        const Clock::time_point start_time = Clock::now();
+        double checksum = 0.0;
+        for (const std::string& query : queries) {
+            const DocumentMatches matches = search_server.MatchDocuments(query, page_ids);
+            for (size_t i = 0; i < page_ids.size(); ++i) {
+                checksum += matches.GetMatchedTerms(i).size();
+            }
+        }
+        AddResult("match_documents_batch"s, 1, queries.size() * page_ids.size(), GetSeconds(start_time), checksum);
+    }
+
+    void RunProcessQueries(const SearchServer& search_server) {
+        const std::vector<std::string> queries = GenerateQueries("process_queries"s, SHORT_QUERY_WORD_COUNT);
+        const Clock::time_point start_time = Clock::now();
+        const std::vector<std::vector<Document>> results = ProcessQueries(search_server, queries);
+        const double seconds = GetSeconds(start_time);
+        double checksum = 0.0;
+        for (const auto& documents : results) {
+            checksum += SumRelevance(documents);
+        }
+        AddResult("process_queries"s, 0, queries.size(), seconds, checksum);
+    }
+
+    // Checksums of the recall benchmarks are the recall, which must be 1
+    // without a budget
+    void RunImpactIndex(const SearchServer& search_server) {
+        const std::vector<std::string> queries = GenerateQueries("impact_find_top"s, SHORT_QUERY_WORD_COUNT);
+        const ImpactIndex impact_index(search_server);
+        const ImpactIndex::Budget budget{ IMPACT_POSTINGS_BUDGET };
+
+        Clock::time_point start_time = Clock::now();
+        double checksum = 0.0;
+        for (const std::string& query : queries) {
+            checksum += SumRelevance(impact_index.FindTopDocuments(query, budget));
+        }
+        AddResult("impact_find_top_budget"s, 1, queries.size(), GetSeconds(start_time), checksum);
+
+        start_time = Clock::now();
+        ImpactIndex::RecallReport report = impact_index.MeasureRecall(queries, ImpactIndex::Budget{});
+        AddResult("impact_recall_full"s, 1, queries.size(), GetSeconds(start_time), report.recall);
+
+        start_time = Clock::now();
+        report = impact_index.MeasureRecall(queries, budget);
+        AddResult("impact_recall_budget"s, 1, queries.size(), GetSeconds(start_time), report.recall);
+    }
+
+    void RunRemoveDocument(SearchServer& search_server) {
+        std::vector<int> seq_ids;
+        std::vector<int> par_ids;
+        for (size_t i = 0; i < corpus_size_; i += REMOVE_PERIOD) {
+            (seq_ids.size() == par_ids.size() ? seq_ids : par_ids).push_back(static_cast<int>(i));
+        }
+
+        Clock::time_point start_time = Clock::now();
+        for (const int document_id : seq_ids) {
+            search_server.RemoveDocument(std::execution::seq, document_id);
+        }
+        AddResult("remove_document_seq"s, 1, seq_ids.size(), GetSeconds(start_time), static_cast<double>(search_server.GetDocumentCount()));
+
+        start_time = Clock::now();
+        for (const int document_id : par_ids) {
+            search_server.RemoveDocument(std::execution::par, document_id);
+        }
+        AddResult("remove_document_par"s, 0, par_ids.size(), GetSeconds(start_time), static_cast<double>(search_server.GetDocumentCount()));
+    }
+
+    void RunRemoveDuplicates(SearchServer& search_server) {
+        // RemoveDuplicates reports every duplicate to std::cout
+        std::ostringstream sink;
+        std::streambuf* const cout_buffer = std::cout.rdbuf(sink.rdbuf());
+        const size_t document_count = search_server.GetDocumentCount();
+        const Clock::time_point start_time = Clock::now();
+        RemoveDuplicates(search_server);
+        const double seconds = GetSeconds(start_time);
+        std::cout.rdbuf(cout_buffer);
+        AddResult("remove_duplicates"s, 1, document_count, seconds, static_cast<double>(search_server.GetDocumentCount()));
+    }
+
+    void RunUpdateDocument(SearchServer& search_server) {
+        std::mt19937 generator = MakeGenerator("update_document"s);
+        std::vector<DocumentUpdate> updates;
+        for (size_t i = 0; i < search_server.GetDocumentCount(); i += UPDATE_PERIOD) {
+            DocumentUpdate update;
+            update.document_id = search_server.GetDocumentId(static_cast<int>(i));
+            update.text = GenerateQuery(generator, dictionary_, distribution_, config_.document_word_count);
+            update.ratings = GenerateRatings(generator);
+            updates.push_back(std::move(update));
+        }
+
+        Clock::time_point start_time = Clock::now();
+        for (const DocumentUpdate& update : updates) {
+            search_server.UpdateDocument(update.document_id, *update.text, DocumentStatus::ACTUAL, *update.ratings);
+        }
+        const double seconds = GetSeconds(start_time);
+        double checksum = 0.0;
+        for (const DocumentUpdate& update : updates) {
+            checksum += search_server.GetWordFrequencies(update.document_id).size();
+        }
+        AddResult("update_document"s, 1, updates.size(), seconds, checksum);
+
+        // Status changes only: no posting is touched
+        for (DocumentUpdate& update : updates) {
+            update.text.reset();
+            update.ratings.reset();
+            update.status = DocumentStatus::BANNED;
+        }
+        start_time = Clock::now();
+        search_server.UpdateDocuments(updates);
+        AddResult("update_documents_status"s, 1, updates.size(), GetSeconds(start_time), static_cast<double>(search_server.GetDocumentCount()));
+    }
+};
+
+}  // namespace
+
+ZipfDistribution::ZipfDistribution(size_t size, double exponent)
+    : cumulative_(size) {
+    double sum = 0.0;
+    for (size_t rank = 0; rank < size; ++rank) {
+        sum += 1.0 / std::pow(rank + 1.0, exponent);
+        cumulative_[rank] = sum;
+    }
+    for (double& value : cumulative_) {
+        value /= sum;
+    }
+}
+
+size_t ZipfDistribution::operator()(std::mt19937& generator) const {
+    const auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), GenerateUnit(generator));
+    return std::min(static_cast<size_t>(it - cumulative_.begin()), cumulative_.size() - 1);
+}
+
+std::string GenerateWord(std::mt19937& generator, int max_length) {
+    const int length = std::uniform_int_distribution(1, max_length)(generator);
+    std::string word;
+    int a_ = 'a';
+    int z_ = 'z';
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(std::uniform_int_distribution(a_, z_)(generator));
+    }
+    return word;
+}
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length) {
+    std::vector<std::string> words;
+    std::unordered_set<std::string> seen_words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        std::string word = GenerateWord(generator, max_length);
+        if (seen_words.insert(word).second) {
+            words.push_back(std::move(word));
+        }
+    }
+    return words;
+}
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& distribution,
+    int word_count, double minus_prob) {
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (GenerateUnit(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[distribution(generator)];
+    }
+    return query;
+}
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& distribution,
+    int query_count, int word_count, double minus_prob) {
+    std::vector<std::string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, distribution, word_count, minus_prob));
+    }
+    return queries;
+}
+
+double BenchmarkResult::GetNanosecondsPerOperation() const {
+    return operation_count == 0 ? 0.0 : seconds * 1e9 / operation_count;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config) {
+    std::vector<BenchmarkResult> results;
+    for (const size_t corpus_size : config.corpus_sizes) {
+        std::vector<BenchmarkResult> corpus_results = BenchmarkRunner(config, corpus_size).Run();
+        results.insert(results.end(), corpus_results.begin(), corpus_results.end());
+    }
+    return results;
+}
+
+void WriteBenchmarkResults(std::ostream& output, const std::vector<BenchmarkResult>& results) {
+    const std::streamsize precision = output.precision(10);
+    output << "name,corpus_size,threads,operations,seconds,ns_per_op,checksum"s << std::endl;
+    for (const BenchmarkResult& result : results) {
+        output << result.name << ','
+            << result.corpus_size << ','
+            << result.thread_count << ','
+            << result.operation_count << ','
+            << result.seconds << ','
+            << result.GetNanosecondsPerOperation() << ','
+            << result.checksum << std::endl;
+    }
+    output.precision(precision);
+}
+
+std::vector<BenchmarkResult> ReadBenchmarkResults(std::istream& input) {
+    std::vector<BenchmarkResult> results;
+    std::string line;
+    // Header
+    std::getline(input, line);
+    while (std::getline(input, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream fields(line);
+        BenchmarkResult result;
+        double nanoseconds_per_operation = 0.0;
+        char comma;
+        if (!std::getline(fields, result.name, ',')
+            || !(fields >> result.corpus_size >> comma >> result.thread_count >> comma >> result.operation_count >> comma
+                >> result.seconds >> comma >> nanoseconds_per_operation >> comma >> result.checksum)) {
+            throw std::invalid_argument("Bad benchmark result line: "s + line);
+        }
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+std::vector<BenchmarkRegression> FindRegressions(const std::vector<BenchmarkResult>& baseline,
+    const std::vector<BenchmarkResult>& current, double tolerance) {
+    // Sums of floating point relevances may differ in the last digits
+    const double checksum_tolerance = 1e-6;
+
+    std::vector<BenchmarkRegression> regressions;
+    for (const BenchmarkResult& result : current) {
+        const auto it = std::find_if(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& baseline_result) {
+            return baseline_result.name == result.name
+                && baseline_result.corpus_size == result.corpus_size
+                && baseline_result.thread_count == result.thread_count;
+            });
+        if (it == baseline.end()) {
+            // A benchmark added without regenerating the baseline; other corpus
+            // sizes and thread counts are simply not compared
+            const bool size_in_baseline = std::any_of(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& baseline_result) {
+                return baseline_result.corpus_size == result.corpus_size;
+                });
+            const bool name_in_baseline = std::any_of(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& baseline_result) {
+                return baseline_result.name == result.name;
+                });
+            if (size_in_baseline && !name_in_baseline) {
+                regressions.push_back({ BenchmarkResult{}, result, "missing from baseline"s });
+            }
+            continue;
+        }
+        if (std::abs(result.checksum - it->checksum) > checksum_tolerance * std::max(1.0, std::abs(it->checksum))) {
+            regressions.push_back({ *it, result, "checksum changed"s });
+        }
+        else if (result.GetNanosecondsPerOperation() > it->GetNanosecondsPerOperation() * (1.0 + tolerance)) {
+            regressions.push_back({ *it, result, "slower"s });
+        }
+    }
+    return regressions;
+}
+
+std::ostream& operator<<(std::ostream& os, const BenchmarkRegression& regression) {
+    os << regression.current.name << " (corpus "s << regression.current.corpus_size
+        << ", threads "s << regression.current.thread_count << "): "s << regression.reason;
+    if (regression.baseline.operation_count == 0) {
+        return os;
+    }
+    os << ", ns/op "s << regression.baseline.GetNanosecondsPerOperation() << " -> "s << regression.current.GetNanosecondsPerOperation()
+        << ", checksum "s << regression.baseline.checksum << " -> "s << regression.current.checksum;
+    return os;
+}
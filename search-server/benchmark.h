@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Corpus and query generators and the benchmark suite run by main.cpp.
+// Everything is generated from BenchmarkConfig::seed, so two runs with the
+// same configuration and toolchain see the same corpus and queries. Each
+// benchmark draws its inputs from its own generator, seeded with its name
+// and the corpus size, so adding a benchmark does not change the others.
+
+// Samples ranks 0..size-1 with probability proportional to 1 / (rank + 1)^exponent
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    std::vector<double> cumulative_;
+};
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+// Unique words in generation order
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+// Words are drawn by rank with a Zipfian frequency, as in natural text
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& distribution,
+    int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& distribution,
+    int query_count, int word_count, double minus_prob = 0);
+
+struct BenchmarkConfig {
+    std::vector<size_t> corpus_sizes = { 10'000 };
+    // Thread counts for the benchmarks that split queries across threads
+    std::vector<size_t> thread_counts = { 1, 2, 4 };
+    int dictionary_size = 10'000;
+    int max_word_length = 10;
+    int document_word_count = 70;
+    int query_count = 100;
+    double zipf_exponent = 1.0;
+    uint32_t seed = 5489;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    size_t corpus_size = 0;
+    // 0 when std::execution::par chooses the threads
+    size_t thread_count = 0;
+    size_t operation_count = 0;
+    double seconds = 0.0;
+    // Depends only on the results, so it must match between runs
+    double checksum = 0.0;
+
+    double GetNanosecondsPerOperation() const;
+};
+
+struct BenchmarkRegression {
+    BenchmarkResult baseline;
+    BenchmarkResult current;
+    std::string reason;
+};
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config);
+
+// CSV with a header line
+void WriteBenchmarkResults(std::ostream& output, const std::vector<BenchmarkResult>& results);
+
+std::vector<BenchmarkResult> ReadBenchmarkResults(std::istream& input);
+
+// Benchmarks slower than the baseline by more than tolerance (0.1 is 10%)
+// or with a different checksum. A benchmark the baseline has no row of at all,
+// though it covers the corpus size, is reported as missing; other rows
+// missing from either side are skipped.
+std::vector<BenchmarkRegression> FindRegressions(const std::vector<BenchmarkResult>& baseline,
+    const std::vector<BenchmarkResult>& current, double tolerance);
+
+std::ostream& operator<<(std::ostream& os, const BenchmarkRegression& regression);
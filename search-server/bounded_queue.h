@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Blocking FIFO with a fixed capacity. Push waits while the queue is full,
+// which makes a fast producer wait for a slow consumer (backpressure).
+// After Close, Pop drains what is left and then returns std::nullopt.
+template <typename Value>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(capacity) {
+    }
+
+    void Push(Value value) {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [this] {
+            return values_.size() < capacity_;
+            });
+        values_.push_back(std::move(value));
+        not_empty_.notify_one();
+    }
+
+    std::optional<Value> Pop() {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this] {
+            return !values_.empty() || closed_;
+            });
+        if (values_.empty()) {
+            return std::nullopt;
+        }
+        Value value = std::move(values_.front());
+        values_.pop_front();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void Close() {
+        std::lock_guard guard(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    std::deque<Value> values_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
@@ -0,0 +1,437 @@
+#include "document_ingestion.h"
+#include "bounded_queue.h"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <thread>
+
+namespace {
+
+// Size of one read from the input stream
+const size_t READ_BLOCK_SIZE = 1 << 20;
+// Lines or documents passed between stages at once
+const size_t BATCH_SIZE = 256;
+// Batches a stage may run ahead of the next one
+const size_t QUEUE_CAPACITY = 16;
+
+using LineBatch = std::vector<std::string>;
+using DocumentBatch = std::vector<ParsedDocument>;
+
+// Words point into the texts of documents, which stay in place when the
+// batch is moved. Documents with invalid words have no words.
+struct TokenizedBatch {
+    DocumentBatch documents;
+    std::vector<std::optional<SearchServer::DocumentWords>> words;
+};
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Not a number: "s + std::string(text));
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text) {
+    if (text == "ACTUAL" || text == "0") {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "IRRELEVANT" || text == "1") {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "BANNED" || text == "2") {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "REMOVED" || text == "3") {
+        return DocumentStatus::REMOVED;
+    }
+    throw std::invalid_argument("Unknown document status: "s + std::string(text));
+}
+
+ParsedDocument ParseTsvLine(std::string_view line) {
+    std::string_view fields[3];
+    for (std::string_view& field : fields) {
+        const size_t tab = line.find('\t');
+        if (tab == line.npos) {
+            throw std::invalid_argument("TSV line must have 4 fields");
+        }
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+
+    ParsedDocument document;
+    document.id = ParseInt(fields[0]);
+    document.status = ParseStatus(fields[1]);
+    for (const std::string_view& rating : SplitIntoWords(fields[2])) {
+        document.ratings.push_back(ParseInt(rating));
+    }
+    document.text = std::string(line);
+    return document;
+}
+
+// Just enough JSON for one object per line: the known keys take numbers,
+// strings or arrays of numbers, the values of unknown keys may be anything
+// and are skipped. Nothing but spaces may follow the object.
+class JsonLineParser {
+public:
+    explicit JsonLineParser(std::string_view line)
+        : text_(line) {
+    }
+
+    ParsedDocument Parse() {
+        ParsedDocument document;
+        bool has_id = false;
+        Expect('{');
+        if (Peek() == '}') {
+            throw std::invalid_argument("JSON document has no id");
+        }
+        for (;;) {
+            const std::string key = ReadString();
+            Expect(':');
+            if (key == "id") {
+                document.id = ParseInt(ReadNumber());
+                has_id = true;
+            }
+            else if (key == "status") {
+                document.status = ParseStatus(Peek() == '"' ? std::string_view(ReadString()) : ReadNumber());
+            }
+            else if (key == "ratings") {
+                document.ratings = ReadNumberArray();
+            }
+            else if (key == "text") {
+                document.text = ReadString();
+            }
+            else {
+                SkipValue();
+            }
+            if (Peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            Expect('}');
+            break;
+        }
+        SkipSpaces();
+        if (pos_ != text_.size()) {
+            throw std::invalid_argument("Unexpected text after JSON object");
+        }
+        if (!has_id) {
+            throw std::invalid_argument("JSON document has no id");
+        }
+        return document;
+    }
+
+private:
+    // Deeper values are rejected rather than recursed into
+    static constexpr int MAX_SKIPPED_DEPTH = 64;
+
+    std::string_view text_;
+    size_t pos_ = 0;
+
+    void SkipSpaces() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    char Peek() {
+        SkipSpaces();
+        if (pos_ == text_.size()) {
+            throw std::invalid_argument("Unexpected end of JSON line");
+        }
+        return text_[pos_];
+    }
+
+    void Expect(char c) {
+        if (Peek() != c) {
+            throw std::invalid_argument("Expected '"s + c + "' in JSON line"s);
+        }
+        ++pos_;
+    }
+
+    std::string ReadString() {
+        Expect('"');
+        std::string result;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c == '\\') {
+                if (pos_ == text_.size()) {
+                    break;
+                }
+                c = text_[pos_++];
+                switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': {
+                    // Only code points below 0x80 are decoded
+                    if (pos_ + 4 > text_.size()) {
+                        throw std::invalid_argument("Bad \\u escape in JSON line");
+                    }
+                    int code = 0;
+                    const auto [end, error] = std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, code, 16);
+                    if (error != std::errc() || end != text_.data() + pos_ + 4 || code >= 0x80) {
+                        throw std::invalid_argument("Bad \\u escape in JSON line");
+                    }
+                    pos_ += 4;
+                    c = static_cast<char>(code);
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+            result.push_back(c);
+        }
+        Expect('"');
+        return result;
+    }
+
+    std::string_view ReadNumber() {
+        Peek();
+        const size_t begin = pos_;
+        while (pos_ < text_.size() && (text_[pos_] == '-' || (text_[pos_] >= '0' && text_[pos_] <= '9'))) {
+            ++pos_;
+        }
+        return text_.substr(begin, pos_ - begin);
+    }
+
+    std::vector<int> ReadNumberArray() {
+        std::vector<int> result;
+        Expect('[');
+        if (Peek() == ']') {
+            ++pos_;
+            return result;
+        }
+        for (;;) {
+            result.push_back(ParseInt(ReadNumber()));
+            if (Peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            Expect(']');
+            return result;
+        }
+    }
+
+    // Skips a value of any type, nested objects and arrays included
+    void SkipValue(int depth = 0) {
+        const char c = Peek();
+        if (c == '"') {
+            ReadString();
+            return;
+        }
+        if (c != '{' && c != '[') {
+            // Number, true, false or null
+            const size_t begin = pos_;
+            while (pos_ < text_.size() && text_[pos_] != ',' && text_[pos_] != '}' && text_[pos_] != ']'
+                && text_[pos_] != ' ' && text_[pos_] != '\t' && text_[pos_] != '\r') {
+                ++pos_;
+            }
+            if (pos_ == begin) {
+                throw std::invalid_argument("Expected a value in JSON line");
+            }
+            return;
+        }
+        if (depth == MAX_SKIPPED_DEPTH) {
+            throw std::invalid_argument("JSON value nested too deeply");
+        }
+        const char close = c == '{' ? '}' : ']';
+        ++pos_;
+        if (Peek() == close) {
+            ++pos_;
+            return;
+        }
+        for (;;) {
+            if (c == '{') {
+                ReadString();
+                Expect(':');
+            }
+            SkipValue(depth + 1);
+            if (Peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            Expect(close);
+            return;
+        }
+    }
+};
+
+}  // namespace
+
+ParsedDocument ParseDocumentLine(const std::string_view& line, InputFormat format) {
+    if (format == InputFormat::TSV) {
+        return ParseTsvLine(line);
+    }
+    return JsonLineParser(line).Parse();
+}
+
+IngestionStats IngestDocuments(SearchServer& search_server, std::istream& input, InputFormat format) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start_time = Clock::now();
+
+    BoundedQueue<LineBatch> line_queue(QUEUE_CAPACITY);
+    BoundedQueue<DocumentBatch> document_queue(QUEUE_CAPACITY);
+    BoundedQueue<TokenizedBatch> tokenized_queue(QUEUE_CAPACITY);
+    std::atomic<size_t> byte_count = 0;
+    std::atomic<size_t> parse_rejected_count = 0;
+    std::atomic<size_t> tokenize_rejected_count = 0;
+    std::exception_ptr read_error;
+
+    std::thread reader([&] {
+        try {
+            std::vector<char> block(READ_BLOCK_SIZE);
+            std::string partial_line;
+            LineBatch batch;
+            while (input) {
+                size_t read_count = 0;
+                {
+                    PROFILE_PHASE(Phase::INGEST_READ);
+                    input.read(block.data(), block.size());
+                    read_count = static_cast<size_t>(input.gcount());
+                }
+                byte_count += read_count;
+
+                std::string_view text(block.data(), read_count);
+                for (size_t newline = text.find('\n'); newline != text.npos; newline = text.find('\n')) {
+                    partial_line.append(text.substr(0, newline));
+                    if (!partial_line.empty() && partial_line.back() == '\r') {
+                        partial_line.pop_back();
+                    }
+                    if (!partial_line.empty()) {
+                        batch.push_back(std::move(partial_line));
+                    }
+                    partial_line.clear();
+                    text.remove_prefix(newline + 1);
+                    if (batch.size() == BATCH_SIZE) {
+                        line_queue.Push(std::move(batch));
+                        batch.clear();
+                    }
+                }
+                partial_line.append(text);
+            }
+            if (!partial_line.empty()) {
+                batch.push_back(std::move(partial_line));
+            }
+            if (!batch.empty()) {
+                line_queue.Push(std::move(batch));
+            }
+        }
+        catch (...) {
+            read_error = std::current_exception();
+        }
+        line_queue.Close();
+        });
+
+    std::thread parser([&] {
+        while (auto lines = line_queue.Pop()) {
+            PROFILE_PHASE(Phase::INGEST_PARSE);
+            DocumentBatch documents;
+            documents.reserve(lines->size());
+            for (const std::string& line : *lines) {
+                try {
+                    documents.push_back(ParseDocumentLine(line, format));
+                }
+                catch (const std::invalid_argument&) {
+                    ++parse_rejected_count;
+                }
+            }
+            document_queue.Push(std::move(documents));
+        }
+        document_queue.Close();
+        });
+
+    // The stop words never change, so words are computed without the index lock
+    std::thread tokenizer([&] {
+        while (auto documents = document_queue.Pop()) {
+            PROFILE_PHASE(Phase::INGEST_TOKENIZE);
+            TokenizedBatch batch{ std::move(*documents), {} };
+            batch.words.reserve(batch.documents.size());
+            for (const ParsedDocument& document : batch.documents) {
+                try {
+                    batch.words.push_back(search_server.ComputeDocumentWords(document.text));
+                }
+                catch (const std::invalid_argument&) {
+                    batch.words.push_back(std::nullopt);
+                    ++tokenize_rejected_count;
+                }
+            }
+            tokenized_queue.Push(std::move(batch));
+        }
+        tokenized_queue.Close();
+        });
+
+    IngestionStats stats;
+    std::exception_ptr index_error;
+    while (auto batch = tokenized_queue.Pop()) {
+        // Keep draining after a failure so that the other stages can finish
+        if (index_error) {
+            continue;
+        }
+        for (size_t i = 0; i < batch->documents.size(); ++i) {
+            const ParsedDocument& document = batch->documents[i];
+            if (!batch->words[i]) {
+                continue;
+            }
+            try {
+                PROFILE_PHASE(Phase::INGEST_INDEX);
+                search_server.AddDocument(document.id, *batch->words[i], document.status, document.ratings);
+                ++stats.document_count;
+            }
+            catch (const std::invalid_argument&) {
+                ++stats.rejected_count;
+            }
+            catch (...) {
+                index_error = std::current_exception();
+                break;
+            }
+        }
+    }
+    reader.join();
+    parser.join();
+    tokenizer.join();
+    if (read_error) {
+        std::rethrow_exception(read_error);
+    }
+    if (index_error) {
+        std::rethrow_exception(index_error);
+    }
+
+    stats.rejected_count += parse_rejected_count + tokenize_rejected_count;
+    stats.byte_count = byte_count;
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    return stats;
+}
+
+IngestionStats IngestDocuments(SearchServer& search_server, const std::string& path, InputFormat format) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::invalid_argument("Can't open "s + path);
+    }
+    return IngestDocuments(search_server, input, format);
+}
+
+double IngestionStats::GetDocumentsPerSecond() const {
+    return seconds > 0.0 ? document_count / seconds : 0.0;
+}
+
+double IngestionStats::GetMegabytesPerSecond() const {
+    return seconds > 0.0 ? byte_count / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+std::ostream& operator<<(std::ostream& os, const IngestionStats& stats) {
+    os << "{ "s
+        << "documents = "s << stats.document_count << ", "s
+        << "rejected = "s << stats.rejected_count << ", "s
+        << "bytes = "s << stats.byte_count << ", "s
+        << "seconds = "s << stats.seconds << ", "s
+        << "docs/sec = "s << stats.GetDocumentsPerSecond() << ", "s
+        << "MB/sec = "s << stats.GetMegabytesPerSecond() << " }"s;
+    return os;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "search_server.h"
+#include <istream>
+#include <string>
+#include <vector>
+
+// Line formats of document dumps.
+// TSV:   id<TAB>status<TAB>ratings<TAB>text, ratings separated by spaces
+// JSONL: {"id": 1, "status": "ACTUAL", "ratings": [1, 2], "text": "..."}
+// Status is either a DocumentStatus name or its number.
+enum class InputFormat {
+    TSV,
+    JSONL,
+};
+
+struct IngestionStats {
+    size_t document_count = 0;
+    // Lines that could not be parsed, had invalid words or were refused by AddDocument
+    size_t rejected_count = 0;
+    size_t byte_count = 0;
+    double seconds = 0.0;
+
+    double GetDocumentsPerSecond() const;
+    double GetMegabytesPerSecond() const;
+};
+
+struct ParsedDocument {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string text;
+};
+
+// Throws std::invalid_argument for malformed lines
+ParsedDocument ParseDocumentLine(const std::string_view& line, InputFormat format);
+
+// Reads the dump in large blocks and runs read -> parse -> tokenize -> index
+// as pipelined stages on separate threads joined by bounded queues. Only the
+// merge of the computed words into the index runs on the calling thread.
+IngestionStats IngestDocuments(SearchServer& search_server, std::istream& input, InputFormat format);
+
+IngestionStats IngestDocuments(SearchServer& search_server, const std::string& path, InputFormat format);
+
+std::ostream& operator<<(std::ostream& os, const IngestionStats& stats);
@@ -0,0 +1,147 @@
+#include "impact_index.h"
+#include <cmath>
+
+ImpactIndex::ImpactIndex(const SearchServer& search_server)
+    : search_server_(search_server) {
+    std::shared_lock lock(search_server_.index_mutex_);
+    generation_ = search_server_.generation_;
+    const CollectionStats stats = search_server_.GetCollectionStats();
+    const TfIdfScorer scorer;
+
+    double min_impact = 0.0;
+    double max_impact = 0.0;
+    for (const auto& [word, postings] : search_server_.word_to_document_freqs_) {
+        const double inverse_document_freq = scorer.InverseDocumentFreq(stats, postings.size());
+        for (const auto [document_id, term_freq] : postings) {
+            const double impact = scorer.Score(term_freq, 0, inverse_document_freq);
+            if (impact > 0.0 && (min_impact == 0.0 || impact < min_impact)) {
+                min_impact = impact;
+            }
+            max_impact = std::max(max_impact, impact);
+        }
+    }
+    // Zero impacts (terms of every document) get 0, the others 1..255 by
+    // their logarithm, which spreads the many small impacts of a Zipfian
+    // corpus over more groups than a linear scale would
+    const double log_range = min_impact > 0.0 ? std::log(max_impact / min_impact) : 0.0;
+    const auto quantize = [&](double impact) -> uint8_t {
+        if (impact <= 0.0) {
+            return 0;
+        }
+        if (log_range <= 0.0) {
+            return 255;
+        }
+        return static_cast<uint8_t>(1 + std::lround(254 * std::log(impact / min_impact) / log_range));
+    };
+
+    std::vector<std::pair<double, int>> impacts;
+    for (const auto& [word, postings] : search_server_.word_to_document_freqs_) {
+        const double inverse_document_freq = scorer.InverseDocumentFreq(stats, postings.size());
+        impacts.clear();
+        for (const auto [document_id, term_freq] : postings) {
+            impacts.push_back({ scorer.Score(term_freq, 0, inverse_document_freq), document_id });
+        }
+        if (impacts.empty()) {
+            continue;
+        }
+        std::sort(impacts.begin(), impacts.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first > rhs.first;
+            });
+
+        auto& segments = term_segments_[word];
+        for (const auto& [impact, document_id] : impacts) {
+            const uint32_t position = static_cast<uint32_t>(document_ids_.size());
+            const uint8_t quantized_impact = quantize(impact);
+            if (segments.empty() || segments.back().impact != quantized_impact) {
+                segments.push_back({ quantized_impact, position, position });
+            }
+            document_ids_.push_back(document_id);
+            impacts_.push_back(impact);
+            segments.back().end = position + 1;
+        }
+    }
+}
+
+std::vector<Document> ImpactIndex::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status, const Budget& budget) const {
+    return ImpactIndex::FindTopDocuments(
+        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        }, budget);
+}
+
+void ImpactIndex::CheckGeneration() const {
+    if (search_server_.generation_ != generation_) {
+        throw std::logic_error("Server changed after the impact index was built");
+    }
+}
+
+std::vector<Document> ImpactIndex::FindTopDocuments(const std::string_view& raw_query, const Budget& budget) const {
+    return ImpactIndex::FindTopDocuments(raw_query, DocumentStatus::ACTUAL, budget);
+}
+
+ImpactIndex::RecallReport ImpactIndex::MeasureRecall(const std::vector<std::string>& queries, const Budget& budget) const {
+    RecallReport report;
+    size_t exact_count = 0;
+    size_t found_count = 0;
+    for (const std::string& raw_query : queries) {
+        const std::vector<Document> exact = search_server_.FindTopDocuments(raw_query);
+
+        size_t postings_scanned = 0;
+        const std::vector<Document> approximate = FindTopDocuments(
+            raw_query, [](int document_id, DocumentStatus document_status, int rating) {
+                return document_status == DocumentStatus::ACTUAL;
+            }, budget, postings_scanned);
+        {
+            std::shared_lock lock(search_server_.index_mutex_);
+            CheckGeneration();
+            for (const Segment& segment : CollectSegments(search_server_.ParseQuery(raw_query))) {
+                report.postings_total += segment.end - segment.begin;
+            }
+        }
+        report.postings_scanned += postings_scanned;
+
+        exact_count += exact.size();
+        // Documents of equal relevance and rating come in no particular
+        // order, so either may fill the last places of the top
+        std::vector<bool> matched(approximate.size());
+        std::vector<const Document*> missed;
+        for (const Document& document : exact) {
+            const auto it = std::find_if(approximate.begin(), approximate.end(), [&document](const Document& found) {
+                return found.id == document.id;
+                });
+            if (it == approximate.end()) {
+                missed.push_back(&document);
+                continue;
+            }
+            matched[it - approximate.begin()] = true;
+            ++found_count;
+        }
+        for (const Document* document : missed) {
+            for (size_t i = 0; i < approximate.size(); ++i) {
+                if (!matched[i] && approximate[i].rating == document->rating
+                    && std::abs(approximate[i].relevance - document->relevance) < epsilon) {
+                    matched[i] = true;
+                    ++found_count;
+                    break;
+                }
+            }
+        }
+        ++report.query_count;
+    }
+    report.recall = exact_count == 0 ? 1.0 : found_count * 1.0 / exact_count;
+    return report;
+}
+
+std::vector<ImpactIndex::Segment> ImpactIndex::CollectSegments(const SearchServer::Query& query) const {
+    std::vector<Segment> segments;
+    for (const std::string_view& word : query.plus_words) {
+        const auto it = term_segments_.find(word);
+        if (it != term_segments_.end()) {
+            segments.insert(segments.end(), it->second.begin(), it->second.end());
+        }
+    }
+    std::stable_sort(segments.begin(), segments.end(), [](const Segment& lhs, const Segment& rhs) {
+        return lhs.impact > rhs.impact;
+        });
+    return segments;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "search_server.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Alternative layout of the inverted index for approximate top-K search.
+// The postings of every term are ordered by TF-IDF impact instead of by
+// document id, grouped by the impact quantized to 8 bits on a log scale, so
+// a query can process the highest impacts of all its terms first
+// (score-at-a-time) and stop whenever the budget runs out. Scores add up the
+// exact impacts, and postings of zero impact are kept in the lowest group,
+// so with an unlimited budget the results are those of
+// SearchServer::FindTopDocuments up to ties.
+//
+// The index is a snapshot: once documents are added to, removed from or
+// updated in the server, queries throw std::logic_error until the index is
+// rebuilt. The server must outlive the index.
+class ImpactIndex {
+public:
+    // Zero means no limit
+    struct Budget {
+        size_t max_postings = 0;
+        std::chrono::nanoseconds max_time{ 0 };
+    };
+
+    struct RecallReport {
+        size_t query_count = 0;
+        // Share of exhaustive top-K documents also found by the budgeted
+        // search; a document tied with it in relevance and rating counts too
+        double recall = 0.0;
+        size_t postings_scanned = 0;
+        size_t postings_total = 0;
+    };
+
+    explicit ImpactIndex(const SearchServer& search_server);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate, const Budget& budget) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status, const Budget& budget) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, const Budget& budget) const;
+
+    // Compares budgeted results with SearchServer::FindTopDocuments on the same queries
+    RecallReport MeasureRecall(const std::vector<std::string>& queries, const Budget& budget) const;
+
+private:
+    // Postings of one term sharing the same quantized impact
+    struct Segment {
+        uint8_t impact;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    const SearchServer& search_server_;
+    // Generation of the server the snapshot was built from
+    uint64_t generation_ = 0;
+    std::map<std::string, std::vector<Segment>, std::less<>> term_segments_;
+    // Postings of all terms, segment after segment
+    std::vector<int> document_ids_;
+    std::vector<double> impacts_;
+
+    // Throws when the server changed after the snapshot was built.
+    // Called with the server lock held.
+    void CheckGeneration() const;
+
+    // Segments of all plus words of the query, highest impact first
+    std::vector<Segment> CollectSegments(const SearchServer::Query& query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate,
+        const Budget& budget, size_t& postings_scanned) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> ImpactIndex::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate, const Budget& budget) const {
+    size_t postings_scanned = 0;
+    return FindTopDocuments(raw_query, document_predicate, budget, postings_scanned);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ImpactIndex::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate,
+    const Budget& budget, size_t& postings_scanned) const {
+    using Clock = std::chrono::steady_clock;
+    // How many postings are scanned between two clock readings
+    const size_t time_check_interval = 1024;
+
+    std::shared_lock lock(search_server_.index_mutex_);
+    CheckGeneration();
+    const SearchServer::Query query = search_server_.ParseQuery(raw_query);
+    const std::vector<int> excluded_documents = search_server_.BuildExcludedDocuments(query);
+    const std::vector<Segment> segments = CollectSegments(query);
+    const Clock::time_point start_time = Clock::now();
+
+    std::unordered_map<int, double> document_to_relevance;
+    bool stopped = false;
+    for (const Segment& segment : segments) {
+        for (uint32_t i = segment.begin; i < segment.end; ++i) {
+            if (budget.max_postings != 0 && postings_scanned == budget.max_postings) {
+                stopped = true;
+                break;
+            }
+            if (budget.max_time.count() != 0 && postings_scanned % time_check_interval == 0
+                && Clock::now() - start_time >= budget.max_time) {
+                stopped = true;
+                break;
+            }
+            ++postings_scanned;
+
+            const int document_id = document_ids_[i];
+            if (std::binary_search(excluded_documents.begin(), excluded_documents.end(), document_id)) {
+                continue;
+            }
+            const auto& document_data = search_server_.documents_.at(document_id);
+            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                document_to_relevance[document_id] += impacts_[i];
+            }
+        }
+        if (stopped) {
+            break;
+        }
+    }
+
+    std::vector<Document> result;
+    result.reserve(document_to_relevance.size());
+    for (const auto [document_id, relevance] : document_to_relevance) {
+        result.push_back({ document_id, relevance, search_server_.documents_.at(document_id).rating });
+    }
+    const auto by_relevance = [](const Document& lhs, const Document& rhs) {
+        if (std::abs(lhs.relevance - rhs.relevance) < epsilon) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.relevance > rhs.relevance;
+    };
+    if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        std::partial_sort(result.begin(), result.begin() + MAX_RESULT_DOCUMENT_COUNT, result.end(), by_relevance);
+        result.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    else {
+        std::sort(result.begin(), result.end(), by_relevance);
+    }
+    return result;
+}
@@ -0,0 +1,351 @@
+#include "index_memory.h"
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std::string_literals;
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+// From linux/mempolicy.h, not every libc ships numaif.h
+const int MPOL_PREFERRED_MODE = 1;
+const int MPOL_INTERLEAVE_MODE = 3;
+const size_t MAX_NUMA_NODES = 64;
+
+// Parses lists like "0-3,8,10-11" from /sys
+std::vector<int> ReadIdList(const std::string& path) {
+    std::vector<int> ids;
+    std::ifstream input(path);
+    std::string range;
+    while (std::getline(input, range, ',')) {
+        if (range.empty() || range[0] == '\n') {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == range.npos ? first : std::stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+std::vector<int> GetOnlineNodes() {
+    try {
+        return ReadIdList("/sys/devices/system/node/online");
+    }
+    catch (const std::exception&) {
+        return {};
+    }
+}
+
+bool PlaceChunk(void* chunk, size_t size, const IndexMemoryConfig& config) {
+    const std::vector<int> nodes = GetOnlineNodes();
+    if (nodes.size() < 2) {
+        return false;
+    }
+    unsigned long node_mask = 0;
+    int mode = MPOL_INTERLEAVE_MODE;
+    if (config.placement == MemoryPlacement::NODE) {
+        if (config.node < 0 || static_cast<size_t>(config.node) >= MAX_NUMA_NODES) {
+            return false;
+        }
+        node_mask = 1ul << config.node;
+        mode = MPOL_PREFERRED_MODE;
+    }
+    else {
+        for (const int node : nodes) {
+            if (static_cast<size_t>(node) < MAX_NUMA_NODES) {
+                node_mask |= 1ul << node;
+            }
+        }
+    }
+    return syscall(SYS_mbind, chunk, size, mode, &node_mask, MAX_NUMA_NODES + 1, 0) == 0;
+}
+#endif
+
+}  // namespace
+
+IndexMemoryResource& IndexMemoryResource::Instance() {
+    // Never destroyed: index containers of static objects may free memory
+    // after the end of main
+    static IndexMemoryResource* resource = new IndexMemoryResource();
+    return *resource;
+}
+
+void IndexMemoryResource::Configure(const IndexMemoryConfig& config) {
+    std::lock_guard guard(mutex_);
+    config_ = config;
+}
+
+IndexMemoryConfig IndexMemoryResource::GetConfig() const {
+    std::lock_guard guard(mutex_);
+    return config_;
+}
+
+thread_local IndexMemoryResource::ThreadCache IndexMemoryResource::thread_cache_;
+
+IndexMemoryResource::ThreadCache::~ThreadCache() {
+    IndexMemoryResource& resource = Instance();
+    std::lock_guard guard(resource.mutex_);
+    if (epoch < resource.reset_epoch_) {
+        return;
+    }
+    for (size_t size_class = 0; size_class < SIZE_CLASS_COUNT; ++size_class) {
+        while (free_lists[size_class].size > 0) {
+            resource.free_lists_[size_class].Push(free_lists[size_class].Pop());
+        }
+    }
+}
+
+void* IndexMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    if (!IsSmall(bytes, alignment)) {
+        {
+            std::lock_guard guard(mutex_);
+            ++stats_.allocation_count;
+            ++stats_.large_allocation_count;
+            stats_.used_bytes += bytes;
+        }
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    const size_t size_class = GetSizeClass(bytes);
+    // Counted before the cache is used, so the chunks can't be reset under it
+    small_used_bytes_ += (size_class + 1) * SIZE_CLASS_STEP;
+    small_allocation_count_.fetch_add(1, std::memory_order_relaxed);
+    ThreadCache& cache = thread_cache_;
+    SyncEpoch(cache);
+    if (cache.free_lists[size_class].size == 0) {
+        Refill(cache, size_class);
+    }
+    return cache.free_lists[size_class].Pop();
+}
+
+void IndexMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    if (!IsSmall(bytes, alignment)) {
+        {
+            std::lock_guard guard(mutex_);
+            stats_.used_bytes -= bytes;
+        }
+        ::operator delete(pointer, std::align_val_t(alignment));
+        return;
+    }
+
+    const size_t size_class = GetSizeClass(bytes);
+    const size_t block_size = (size_class + 1) * SIZE_CLASS_STEP;
+    ThreadCache& cache = thread_cache_;
+    // The block is still counted as used, so the chunks can't be refilled
+    // until it is in the cache
+    SyncEpoch(cache);
+    cache.free_lists[size_class].Push(static_cast<FreeBlock*>(pointer));
+    if (cache.free_lists[size_class].size >= 2 * CACHE_BATCH_SIZE) {
+        Flush(cache, size_class);
+    }
+    if (small_used_bytes_.fetch_sub(block_size) == block_size) {
+        TryReset();
+    }
+}
+
+bool IndexMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+IndexMemoryStats IndexMemoryResource::GetStats() const {
+    std::lock_guard guard(mutex_);
+    IndexMemoryStats stats = stats_;
+    stats.used_bytes += small_used_bytes_;
+    stats.allocation_count += small_allocation_count_;
+    return stats;
+}
+
+void IndexMemoryResource::SyncEpoch(ThreadCache& cache) {
+    if (cache.epoch == epoch_) {
+        return;
+    }
+    // The caller holds a counted block, so no reset can complete until it
+    // is done; under the lock none is half done either
+    std::lock_guard guard(mutex_);
+    if (cache.epoch < reset_epoch_) {
+        // The blocks lie in chunks that were refilled from the start
+        cache.free_lists.fill(FreeList());
+    }
+    cache.epoch = epoch_;
+}
+
+void IndexMemoryResource::Refill(ThreadCache& cache, size_t size_class) {
+    const size_t block_size = (size_class + 1) * SIZE_CLASS_STEP;
+    FreeList& cached = cache.free_lists[size_class];
+    std::lock_guard guard(mutex_);
+    cache.epoch = epoch_;
+    FreeList& pooled = free_lists_[size_class];
+    while (cached.size < CACHE_BATCH_SIZE && pooled.size > 0) {
+        cached.Push(pooled.Pop());
+    }
+    // Carved blocks are pushed in reverse so that they are handed out in address order
+    std::array<FreeBlock*, CACHE_BATCH_SIZE> carved;
+    size_t carved_count = 0;
+    while (cached.size + carved_count < CACHE_BATCH_SIZE) {
+        if (chunk_end_ - chunk_position_ < static_cast<std::ptrdiff_t>(block_size)) {
+            NextChunk();
+        }
+        carved[carved_count++] = reinterpret_cast<FreeBlock*>(chunk_position_);
+        chunk_position_ += block_size;
+    }
+    while (carved_count > 0) {
+        cached.Push(carved[--carved_count]);
+    }
+}
+
+void IndexMemoryResource::Flush(ThreadCache& cache, size_t size_class) {
+    FreeList& cached = cache.free_lists[size_class];
+    std::lock_guard guard(mutex_);
+    FreeList& pooled = free_lists_[size_class];
+    for (size_t i = 0; i < CACHE_BATCH_SIZE; ++i) {
+        pooled.Push(cached.Pop());
+    }
+}
+
+bool IndexMemoryResource::TryReset() {
+    std::lock_guard guard(mutex_);
+    if (chunks_.empty()) {
+        return false;
+    }
+    // The epoch changes before the count is checked again: an allocation
+    // counted after the check sees the new epoch and syncs its cache under
+    // the lock, one counted before it stops the reset. Caches of a stopped
+    // reset stay valid.
+    ++epoch_;
+    if (small_used_bytes_ != 0) {
+        return false;
+    }
+    reset_epoch_ = epoch_;
+    free_lists_.fill(FreeList());
+    current_chunk_ = 0;
+    chunk_position_ = chunks_.front();
+    chunk_end_ = chunk_position_ + CHUNK_SIZE;
+    return true;
+}
+
+void IndexMemoryResource::NextChunk() {
+    // The rest of the current chunk, too small for the block, is abandoned
+    if (chunk_position_ != nullptr && current_chunk_ + 1 < chunks_.size()) {
+        ++current_chunk_;
+    }
+    else {
+        chunks_.push_back(MapChunk());
+        current_chunk_ = chunks_.size() - 1;
+    }
+    chunk_position_ = chunks_[current_chunk_];
+    chunk_end_ = chunk_position_ + CHUNK_SIZE;
+}
+
+char* IndexMemoryResource::MapChunk() {
+    void* chunk = nullptr;
+#ifdef __linux__
+    if (config_.use_huge_pages) {
+        chunk = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (chunk == MAP_FAILED) {
+            chunk = nullptr;
+            ++stats_.huge_page_fallback_count;
+        }
+        else {
+            ++stats_.huge_page_chunk_count;
+        }
+    }
+    if (chunk == nullptr) {
+        // Aligned to CHUNK_SIZE, so that transparent huge pages can back it
+        void* region = mmap(nullptr, 2 * CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char* const region_begin = static_cast<char*>(region);
+        char* const aligned = region_begin + (CHUNK_SIZE - reinterpret_cast<uintptr_t>(region_begin) % CHUNK_SIZE) % CHUNK_SIZE;
+        if (aligned != region_begin) {
+            munmap(region_begin, aligned - region_begin);
+        }
+        munmap(aligned + CHUNK_SIZE, region_begin + 2 * CHUNK_SIZE - (aligned + CHUNK_SIZE));
+        chunk = aligned;
+        if (config_.use_huge_pages) {
+            // Transparent huge pages may still back the chunk
+            madvise(chunk, CHUNK_SIZE, MADV_HUGEPAGE);
+        }
+    }
+    if (config_.placement != MemoryPlacement::DEFAULT) {
+        if (PlaceChunk(chunk, CHUNK_SIZE, config_)) {
+            ++stats_.placed_chunk_count;
+        }
+        else {
+            ++stats_.placement_fallback_count;
+        }
+    }
+#else
+    chunk = ::operator new(CHUNK_SIZE);
+    if (config_.use_huge_pages) {
+        ++stats_.huge_page_fallback_count;
+    }
+    if (config_.placement != MemoryPlacement::DEFAULT) {
+        ++stats_.placement_fallback_count;
+    }
+#endif
+    ++stats_.chunk_count;
+    stats_.mapped_bytes += CHUNK_SIZE;
+    return static_cast<char*>(chunk);
+}
+
+int GetNumaNodeCount() {
+#ifdef __linux__
+    const std::vector<int> nodes = GetOnlineNodes();
+    return nodes.empty() ? 1 : static_cast<int>(nodes.size());
+#else
+    return 1;
+#endif
+}
+
+bool BindCurrentThreadToNode(int node) {
+#ifdef __linux__
+    std::vector<int> cpus;
+    try {
+        cpus = ReadIdList("/sys/devices/system/node/node"s + std::to_string(node) + "/cpulist"s);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::ostream& operator<<(std::ostream& os, const IndexMemoryStats& stats) {
+    os << "{ "s
+        << "chunks = "s << stats.chunk_count << ", "s
+        << "huge page chunks = "s << stats.huge_page_chunk_count << ", "s
+        << "huge page fallbacks = "s << stats.huge_page_fallback_count << ", "s
+        << "placed chunks = "s << stats.placed_chunk_count << ", "s
+        << "placement fallbacks = "s << stats.placement_fallback_count << ", "s
+        << "mapped bytes = "s << stats.mapped_bytes << ", "s
+        << "used bytes = "s << stats.used_bytes << ", "s
+        << "allocations = "s << stats.allocation_count << ", "s
+        << "large allocations = "s << stats.large_allocation_count << " }"s;
+    return os;
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Memory of the SearchServer index (posting lists, term dictionary and
+// document table). The index containers allocate from the memory resource
+// given to the SearchServer constructor, IndexMemoryResource by default,
+// which carves their nodes out of 2 MiB chunks.
+//
+// Chunks can be backed by huge pages and placed on NUMA nodes. Whatever the
+// system refuses (no reserved huge pages, a single node, not Linux) falls
+// back to ordinary pages, and IndexMemoryStats shows what was actually used.
+// Freed nodes are reused for new nodes of the same size. Each thread keeps a
+// small cache of free nodes per size and exchanges them with the shared
+// pool in batches, so concurrent allocations and frees (RemoveDocument with
+// std::execution::par) rarely take the pool lock. Chunks are never returned
+// to the system; once everything is freed they are refilled from the start,
+// so a rebuilt index is laid out in allocation order again.
+
+enum class MemoryPlacement {
+    // Whatever the system policy is
+    DEFAULT,
+    // Prefer the node given in IndexMemoryConfig::node
+    NODE,
+    // Spread pages round-robin over all nodes
+    INTERLEAVE,
+};
+
+struct IndexMemoryConfig {
+    bool use_huge_pages = false;
+    MemoryPlacement placement = MemoryPlacement::DEFAULT;
+    int node = 0;
+};
+
+struct IndexMemoryStats {
+    size_t chunk_count = 0;
+    // Chunks on explicit huge pages
+    size_t huge_page_chunk_count = 0;
+    // Chunks on ordinary pages although huge pages were requested
+    size_t huge_page_fallback_count = 0;
+    // Chunks that got the requested NUMA placement
+    size_t placed_chunk_count = 0;
+    // Chunks left to the system policy although a placement was requested
+    size_t placement_fallback_count = 0;
+    size_t mapped_bytes = 0;
+    // Bytes handed out and not freed yet
+    size_t used_bytes = 0;
+    size_t allocation_count = 0;
+    // Allocations too large for the chunks, served by operator new
+    size_t large_allocation_count = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const IndexMemoryStats& stats);
+
+class IndexMemoryResource : public std::pmr::memory_resource {
+public:
+    static constexpr size_t CHUNK_SIZE = 2 << 20;
+
+    static IndexMemoryResource& Instance();
+
+    // Applies to chunks mapped afterwards, so configure before building the index
+    void Configure(const IndexMemoryConfig& config);
+
+    IndexMemoryConfig GetConfig() const;
+
+    IndexMemoryStats GetStats() const;
+
+    // Refills the chunks from the start if nothing is in use any more and
+    // returns whether it did. Called when the last block in use is freed.
+    bool TryReset();
+
+private:
+    static constexpr size_t SIZE_CLASS_STEP = 16;
+    static constexpr size_t SIZE_CLASS_COUNT = 16;
+    static constexpr size_t MAX_SMALL_SIZE = SIZE_CLASS_STEP * SIZE_CLASS_COUNT;
+    // Blocks moved between a thread cache and the pool at a time
+    static constexpr size_t CACHE_BATCH_SIZE = 32;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FreeList {
+        FreeBlock* head = nullptr;
+        size_t size = 0;
+
+        void Push(FreeBlock* block) {
+            block->next = head;
+            head = block;
+            ++size;
+        }
+
+        FreeBlock* Pop() {
+            FreeBlock* block = head;
+            head = block->next;
+            --size;
+            return block;
+        }
+    };
+
+    struct ThreadCache {
+        std::array<FreeList, SIZE_CLASS_COUNT> free_lists;
+        // Blocks are only valid in the epoch they were cached in
+        uint64_t epoch = 0;
+
+        // Gives the cached blocks back to the pool
+        ~ThreadCache();
+    };
+
+    static thread_local ThreadCache thread_cache_;
+
+    mutable std::mutex mutex_;
+    IndexMemoryConfig config_;
+    // Chunk and large allocation statistics, guarded by mutex_
+    IndexMemoryStats stats_;
+    std::array<FreeList, SIZE_CLASS_COUNT> free_lists_;
+    std::vector<char*> chunks_;
+    // Chunk being filled, chunks after it are empty
+    size_t current_chunk_ = 0;
+    char* chunk_position_ = nullptr;
+    char* chunk_end_ = nullptr;
+    // Bytes of small blocks held by containers, cached blocks excluded
+    std::atomic<size_t> small_used_bytes_ = 0;
+    std::atomic<size_t> small_allocation_count_ = 0;
+    // Incremented, under mutex_, by every reset attempt
+    std::atomic<uint64_t> epoch_ = 1;
+    // Epoch of the last reset that refilled the chunks, guarded by mutex_.
+    // Thread caches of an older epoch are dropped, the others are still valid.
+    uint64_t reset_epoch_ = 0;
+
+    IndexMemoryResource() = default;
+
+    ~IndexMemoryResource() = default;
+
+    static bool IsSmall(size_t bytes, size_t alignment) {
+        return bytes <= MAX_SMALL_SIZE && alignment <= SIZE_CLASS_STEP;
+    }
+
+    static size_t GetSizeClass(size_t bytes) {
+        return bytes == 0 ? 0 : (bytes - 1) / SIZE_CLASS_STEP;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    // Moves a cache of an older epoch to the current one, emptying it if the
+    // chunks were refilled meanwhile
+    void SyncEpoch(ThreadCache& cache);
+
+    // Moves up to CACHE_BATCH_SIZE free blocks to the cache, carving new
+    // ones from the chunks when the pool has too few
+    void Refill(ThreadCache& cache, size_t size_class);
+
+    // Moves CACHE_BATCH_SIZE blocks of the cache back to the pool
+    void Flush(ThreadCache& cache, size_t size_class);
+
+    // Moves to the next chunk, mapping it if needed. Requires mutex_ to be held.
+    void NextChunk();
+
+    // Requires mutex_ to be held
+    char* MapChunk();
+};
+
+// Number of NUMA nodes of the machine, 1 where it can't be determined
+int GetNumaNodeCount();
+
+// Restricts the calling thread to the CPUs of the node. Returns false and
+// leaves the thread as it was if that is not possible.
+bool BindCurrentThreadToNode(int node);
@@ -0,0 +1,197 @@
+#include "instrumentation.h"
+#include <string>
+
+using namespace std::string_literals;
+
+const char* GetPhaseName(Phase phase) {
+    switch (phase) {
+    case Phase::QUERY_PARSE: return "query_parse";
+    case Phase::TERM_RESOLVE: return "term_resolve";
+    case Phase::POSTINGS_SCAN: return "postings_scan";
+    case Phase::EXCLUSION: return "exclusion";
+    case Phase::TOP_K: return "top_k";
+    case Phase::RESULT_BUILD: return "result_build";
+    case Phase::INGEST_READ: return "ingest_read";
+    case Phase::INGEST_PARSE: return "ingest_parse";
+    case Phase::INGEST_TOKENIZE: return "ingest_tokenize";
+    case Phase::INGEST_INDEX: return "ingest_index";
+    default: return "unknown";
+    }
+}
+
+const char* GetCounterName(Counter counter) {
+    switch (counter) {
+    case Counter::POSTINGS_SCANNED: return "postings_scanned";
+    case Counter::CANDIDATES: return "candidates";
+    default: return "unknown";
+    }
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    std::atomic<uint64_t>& bucket = buckets_[GetBucketIndex(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total_.store(total_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed)) {
+        max_.store(value, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    total_.fetch_add(other.total_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    const uint64_t other_max = other.max_.load(std::memory_order_relaxed);
+    if (other_max > max_.load(std::memory_order_relaxed)) {
+        max_.store(other_max, std::memory_order_relaxed);
+    }
+}
+
+PhaseStats LatencyHistogram::GetStats() const {
+    PhaseStats stats;
+    std::array<uint64_t, BUCKET_COUNT> buckets;
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+    // Summed from the buckets so the percentiles agree with the count even
+    // when values are recorded while the snapshot is taken
+    stats.count = count;
+    stats.total = total_.load(std::memory_order_relaxed);
+    stats.max = max_.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return stats;
+    }
+
+    const std::array<std::pair<double, uint64_t*>, 3> percentiles = { {
+        { 0.5, &stats.p50 },
+        { 0.99, &stats.p99 },
+        { 0.999, &stats.p999 },
+    } };
+    uint64_t seen = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < BUCKET_COUNT && next < percentiles.size(); ++i) {
+        seen += buckets[i];
+        while (next < percentiles.size() && seen >= percentiles[next].first * count) {
+            *percentiles[next].second = std::min(GetBucketLowerBound(i), stats.max);
+            ++next;
+        }
+    }
+    return stats;
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63;
+    while ((value >> exponent) == 0) {
+        --exponent;
+    }
+    const size_t sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const int exponent = static_cast<int>(index / SUB_BUCKET_COUNT) + SUB_BUCKET_BITS - 1;
+    const uint64_t sub_bucket = index % SUB_BUCKET_COUNT;
+    return (SUB_BUCKET_COUNT + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+Metrics& Metrics::Instance() {
+    // Never destroyed: threads still running after the end of main give
+    // their metrics back when they exit
+    static Metrics* metrics = new Metrics();
+    return *metrics;
+}
+
+Metrics::ThreadMetrics& Metrics::GetThreadMetrics() {
+    struct Holder {
+        ThreadMetrics* metrics = nullptr;
+
+        ~Holder() {
+            if (metrics != nullptr) {
+                Metrics& instance = Instance();
+                std::lock_guard guard(instance.mutex_);
+                instance.free_thread_metrics_.push_back(metrics);
+            }
+        }
+    };
+    thread_local Holder holder;
+    if (holder.metrics == nullptr) {
+        std::lock_guard guard(mutex_);
+        if (free_thread_metrics_.empty()) {
+            thread_metrics_.push_back(std::make_unique<ThreadMetrics>());
+            holder.metrics = thread_metrics_.back().get();
+        }
+        else {
+            holder.metrics = free_thread_metrics_.back();
+            free_thread_metrics_.pop_back();
+        }
+    }
+    return *holder.metrics;
+}
+
+MetricsSnapshot Metrics::GetSnapshot() const {
+    MetricsSnapshot snapshot;
+    // About 8 KiB per phase, too much for the stack
+    const auto phases = std::make_unique<std::array<LatencyHistogram, PHASE_COUNT>>();
+    {
+        std::lock_guard guard(mutex_);
+        for (const auto& thread_metrics : thread_metrics_) {
+            for (size_t i = 0; i < PHASE_COUNT; ++i) {
+                (*phases)[i].Merge(thread_metrics->phases[i]);
+            }
+            for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+                snapshot.counters[i] += thread_metrics->counters[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        snapshot.phases[i] = (*phases)[i].GetStats();
+    }
+    return snapshot;
+}
+
+void Metrics::Reset() {
+    std::lock_guard guard(mutex_);
+    for (const auto& thread_metrics : thread_metrics_) {
+        for (auto& phase : thread_metrics->phases) {
+            phase.Reset();
+        }
+        for (auto& counter : thread_metrics->counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const MetricsSnapshot& snapshot) {
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        const PhaseStats& stats = snapshot.phases[i];
+        if (stats.count == 0) {
+            continue;
+        }
+        os << GetPhaseName(static_cast<Phase>(i)) << ": "s
+            << "count = "s << stats.count << ", "s
+            << "p50 = "s << stats.p50 << " ns, "s
+            << "p99 = "s << stats.p99 << " ns, "s
+            << "p999 = "s << stats.p999 << " ns, "s
+            << "max = "s << stats.max << " ns"s << std::endl;
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        os << GetCounterName(static_cast<Counter>(i)) << ": "s << snapshot.counters[i] << std::endl;
+    }
+    return os;
+}
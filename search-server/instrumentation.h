@@ -0,0 +1,171 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Phase timings and counters of queries and ingestion.
+//
+// Build with SEARCH_SERVER_INSTRUMENTATION defined to record them. Without it
+// PROFILE_PHASE and PROFILE_COUNT expand to nothing, so instrumented code
+// costs nothing and Metrics::Instance().GetSnapshot() stays empty.
+//
+// Example:
+//
+//  void Search() {
+//      PROFILE_PHASE(Phase::POSTINGS_SCAN); // Records the time until the end of the block
+//      ...
+//      PROFILE_COUNT(Counter::POSTINGS_SCANNED, postings.size());
+//  }
+//
+//  MetricsSnapshot snapshot = Metrics::Instance().GetSnapshot();
+//  std::cout << snapshot;
+
+enum class Phase {
+    QUERY_PARSE,
+    TERM_RESOLVE,
+    POSTINGS_SCAN,
+    EXCLUSION,
+    TOP_K,
+    RESULT_BUILD,
+    INGEST_READ,
+    INGEST_PARSE,
+    INGEST_TOKENIZE,
+    INGEST_INDEX,
+    COUNT,
+};
+
+enum class Counter {
+    POSTINGS_SCANNED,
+    CANDIDATES,
+    COUNT,
+};
+
+inline constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::COUNT);
+inline constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+const char* GetPhaseName(Phase phase);
+
+const char* GetCounterName(Counter counter);
+
+// Durations are in nanoseconds
+struct PhaseStats {
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+};
+
+struct MetricsSnapshot {
+    std::array<PhaseStats, PHASE_COUNT> phases;
+    std::array<uint64_t, COUNTER_COUNT> counters{};
+};
+
+std::ostream& operator<<(std::ostream& os, const MetricsSnapshot& snapshot);
+
+// Log-linear histogram in the style of HdrHistogram: each power of two is
+// split into 16 buckets, so a recorded value is off by at most 1/16.
+// Only one thread may record into a histogram, so recording is a relaxed
+// load and store with no locks or read-modify-write; other threads may read
+// it meanwhile.
+class LatencyHistogram {
+public:
+    void Record(uint64_t value);
+
+    PhaseStats GetStats() const;
+
+    // Adds the values recorded in other
+    void Merge(const LatencyHistogram& other);
+
+    void Reset();
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> total_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+
+    static size_t GetBucketIndex(uint64_t value);
+
+    static uint64_t GetBucketLowerBound(size_t index);
+};
+
+// Every thread records into histograms and counters of its own, so
+// recording threads share no cache lines. GetSnapshot merges them. When a
+// thread exits, its values are kept and its histograms go to the next new
+// thread.
+class Metrics {
+public:
+    static Metrics& Instance();
+
+    void Record(Phase phase, uint64_t nanoseconds) {
+        GetThreadMetrics().phases[static_cast<size_t>(phase)].Record(nanoseconds);
+    }
+
+    void Add(Counter counter, uint64_t value) {
+        std::atomic<uint64_t>& total = GetThreadMetrics().counters[static_cast<size_t>(counter)];
+        total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    MetricsSnapshot GetSnapshot() const;
+
+    // Values recorded while it runs may be kept
+    void Reset();
+
+private:
+    struct alignas(64) ThreadMetrics {
+        std::array<LatencyHistogram, PHASE_COUNT> phases;
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadMetrics>> thread_metrics_;
+    // Metrics of exited threads, recorded into by no one
+    std::vector<ThreadMetrics*> free_thread_metrics_;
+
+    Metrics() = default;
+
+    ThreadMetrics& GetThreadMetrics();
+};
+
+// Records the time from construction to destruction into the phase histogram
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PhaseTimer(Phase phase)
+        : phase_(phase) {
+    }
+
+    ~PhaseTimer() {
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+        Metrics::Instance().Record(phase_, static_cast<uint64_t>(duration.count()));
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    const Phase phase_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+#define PROFILE_PHASE_CONCAT_INTERNAL(X, Y) X##Y
+#define PROFILE_PHASE_CONCAT(X, Y) PROFILE_PHASE_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+#define PROFILE_PHASE(phase) PhaseTimer PROFILE_PHASE_CONCAT(phaseTimer, __LINE__)(phase)
+#define PROFILE_COUNT(counter, value) Metrics::Instance().Add(counter, value)
+#else
+#define PROFILE_PHASE(phase)
+#define PROFILE_COUNT(counter, value)
+#endif
@@ -1,76 +1,110 @@
-#include "search_server.h"
+#include "benchmark.h"
+#include "index_memory.h"
 #include "log_duration.h"
-#include <execution>
+#include "search_server_tests.h"
+#include <fstream>
 #include <iostream>
-#include <random>
+#include <sstream>
 #include <string>
 #include <vector>
-#include"process_queries.h"
 
 using namespace std;
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    int a_ = 'a';
-    int z_ = 'z';
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution(a_, z_)(generator));
-    }
-    return word;
-}
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
+
+// Usage: search-server [--sizes 10000,100000] [--threads 1,2,4] [--queries 100]
+//                      [--seed 5489] [--zipf 1.0] [--output results.csv]
+//                      [--baseline benchmark_baseline.csv] [--tolerance 0.2]
+//                      [--huge-pages 1] [--placement interleave|node:N]
+// Configures the index memory and runs TestSearchServer, then prints the
+// benchmark results as CSV and exits with 1 when a benchmark regressed
+// against the baseline. Test progress, the total benchmark time and index
+// memory statistics go to std::cerr.
+
+vector<size_t> ParseSizeList(const string& text) {
+    vector<size_t> values;
+    istringstream input(text);
+    string value;
+    while (getline(input, value, ',')) {
+        values.push_back(stoull(value));
     }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
+    return values;
 }
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    string output_path;
+    string baseline_path;
+    double tolerance = 0.2;
+    IndexMemoryConfig memory_config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const string option = argv[i];
+        const string value = argv[i + 1];
+        if (option == "--sizes"s) {
+            config.corpus_sizes = ParseSizeList(value);
+        }
+        else if (option == "--threads"s) {
+            config.thread_counts = ParseSizeList(value);
+        }
+        else if (option == "--queries"s) {
+            config.query_count = stoi(value);
+        }
+        else if (option == "--seed"s) {
+            config.seed = static_cast<uint32_t>(stoul(value));
+        }
+        else if (option == "--zipf"s) {
+            config.zipf_exponent = stod(value);
+        }
+        else if (option == "--output"s) {
+            output_path = value;
+        }
+        else if (option == "--baseline"s) {
+            baseline_path = value;
+        }
+        else if (option == "--tolerance"s) {
+            tolerance = stod(value);
+        }
+        else if (option == "--huge-pages"s) {
+            memory_config.use_huge_pages = value != "0"s;
         }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
+        else if (option == "--placement"s && value == "interleave"s) {
+            memory_config.placement = MemoryPlacement::INTERLEAVE;
+        }
+        else if (option == "--placement"s && value.rfind("node:"s, 0) == 0) {
+            memory_config.placement = MemoryPlacement::NODE;
+            memory_config.node = stoi(value.substr(5));
+        }
+        else {
+            cerr << "Unknown option "s << option << endl;
+            return 2;
         }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
     }
-    return query;
-}
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+
+    // Before the tests: chunks they map are reused by the benchmark index
+    IndexMemoryResource::Instance().Configure(memory_config);
+    TestSearchServer();
+
+    vector<BenchmarkResult> results;
+    {
+        LOG_DURATION("Benchmarks"s);
+        results = RunBenchmarks(config);
     }
-    return queries;
-}
-template <typename ExecutionPolicy>
-void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    double total_relevance = 0;
-    for (const string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
-            total_relevance += document.relevance;
-        }
+    cerr << "Index memory: "s << IndexMemoryResource::Instance().GetStats() << " on "s << GetNumaNodeCount() << " NUMA node(s)"s << endl;
+    WriteBenchmarkResults(cout, results);
+    if (!output_path.empty()) {
+        ofstream output(output_path);
+        WriteBenchmarkResults(output, results);
     }
-    cout << total_relevance << endl;
-}
-#define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-int main() {
-    mt19937 generator;
-    const auto dictionary = GenerateDictionary(generator, 1000, 10);
-    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
-    SearchServer search_server(dictionary[0]);
-    for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+
+    if (baseline_path.empty()) {
+        return 0;
     }
-    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
-    TEST(seq);
-    TEST(par);
+    ifstream baseline_input(baseline_path);
+    if (!baseline_input) {
+        cerr << "Can't open baseline "s << baseline_path << endl;
+        return 2;
+    }
+    const vector<BenchmarkRegression> regressions = FindRegressions(ReadBenchmarkResults(baseline_input), results, tolerance);
+    for (const BenchmarkRegression& regression : regressions) {
+        cerr << "REGRESSION "s << regression << endl;
+    }
+    return regressions.empty() ? 0 : 1;
 }
-
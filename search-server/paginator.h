@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <iostream>
+#include <utility>
 
 template <typename Iterator>
 class IteratorRange {
@@ -58,6 +59,64 @@ private:
     std::vector<IteratorRange<Iterator>> pages_;
 };
 
+// Paginator over a cursor with a NextPage() method that returns an empty
+// page at the end. Only the current page is kept in memory, and the pages
+// can be iterated once.
+template <typename Cursor>
+class CursorPaginator {
+public:
+    using Page = decltype(std::declval<Cursor&>().NextPage());
+
+    class Iterator {
+    public:
+        Iterator() = default;
+
+        explicit Iterator(Cursor* cursor)
+            : cursor_(cursor) {
+            ++*this;
+        }
+
+        IteratorRange<typename Page::const_iterator> operator*() const {
+            return { page_.cbegin(), page_.cend() };
+        }
+
+        Iterator& operator++() {
+            page_ = cursor_->NextPage();
+            if (page_.empty()) {
+                cursor_ = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return cursor_ == other.cursor_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return cursor_ != other.cursor_;
+        }
+
+    private:
+        Cursor* cursor_ = nullptr;
+        Page page_;
+    };
+
+    explicit CursorPaginator(Cursor& cursor)
+        : cursor_(cursor) {
+    }
+
+    Iterator begin() const {
+        return Iterator(&cursor_);
+    }
+
+    Iterator end() const {
+        return Iterator();
+    }
+
+private:
+    Cursor& cursor_;
+};
+
 template <typename Iterator>
 std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& range) {
     for (Iterator it = range.begin(); it != range.end(); ++it) {
@@ -0,0 +1,150 @@
+#include "query_service.h"
+
+QueryService::QueryService(const SearchServer& search_server, size_t thread_count, size_t max_batch_size,
+    const std::vector<int>& worker_nodes)
+    : search_server_(search_server)
+    , max_batch_size_(std::max<size_t>(max_batch_size, 1)) {
+    if (thread_count == 0) {
+        throw std::invalid_argument("Query service needs at least one thread");
+    }
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        const int node = worker_nodes.empty() ? -1 : worker_nodes[i % worker_nodes.size()];
+        workers_.emplace_back([this, node] {
+            if (node >= 0) {
+                BindCurrentThreadToNode(node);
+            }
+            RunWorker();
+            });
+    }
+}
+
+QueryService::~QueryService() {
+    {
+        std::lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    queue_changed_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    for (PendingQuery& query : queue_) {
+        query.result.set_exception(std::make_exception_ptr(QueryCancelled("Query service stopped")));
+    }
+}
+
+QueryHandle QueryService::Submit(std::string raw_query, DocumentStatus status, Clock::duration timeout) {
+    PendingQuery query;
+    query.raw_query = std::move(raw_query);
+    query.status = status;
+    query.deadline = timeout == Clock::duration::zero() ? Clock::time_point::max() : Clock::now() + timeout;
+    query.cancelled = std::make_shared<std::atomic<bool>>(false);
+    QueryHandle handle(query.result.get_future(), query.cancelled);
+    {
+        std::lock_guard guard(mutex_);
+        queue_.push_back(std::move(query));
+    }
+    queue_changed_.notify_one();
+    return handle;
+}
+
+void QueryService::Pause() {
+    std::lock_guard guard(mutex_);
+    paused_ = true;
+}
+
+void QueryService::Resume() {
+    {
+        std::lock_guard guard(mutex_);
+        paused_ = false;
+    }
+    queue_changed_.notify_all();
+}
+
+uint64_t QueryService::GetSearchCount() const {
+    return search_count_.load(std::memory_order_relaxed);
+}
+
+const char* QueryService::PendingQuery::GetStopReason(Clock::time_point now) const {
+    if (cancelled->load(std::memory_order_relaxed)) {
+        return "Query cancelled";
+    }
+    if (now >= deadline) {
+        return "Query deadline exceeded";
+    }
+    return nullptr;
+}
+
+void QueryService::RunWorker() {
+    std::vector<PendingQuery> batch;
+    for (;;) {
+        {
+            std::unique_lock lock(mutex_);
+            queue_changed_.wait(lock, [this] {
+                return stopping_ || (!paused_ && !queue_.empty());
+                });
+            if (stopping_) {
+                return;
+            }
+            while (!queue_.empty() && batch.size() < max_batch_size_) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+        ProcessBatch(batch);
+        batch.clear();
+    }
+}
+
+void QueryService::ProcessBatch(std::vector<PendingQuery>& batch) {
+    // Identical queries end up next to each other
+    std::stable_sort(batch.begin(), batch.end(), [](const PendingQuery& lhs, const PendingQuery& rhs) {
+        if (lhs.status != rhs.status) {
+            return lhs.status < rhs.status;
+        }
+        return lhs.raw_query < rhs.raw_query;
+        });
+
+    for (auto group_begin = batch.begin(); group_begin != batch.end();) {
+        const auto group_end = std::find_if(group_begin, batch.end(), [&group_begin](const PendingQuery& query) {
+            return query.status != group_begin->status || query.raw_query != group_begin->raw_query;
+            });
+        // A shared query stops only when nobody waits for it any more
+        const auto should_stop = [group_begin, group_end] {
+            const Clock::time_point now = Clock::now();
+            return std::all_of(group_begin, group_end, [now](const PendingQuery& query) {
+                return query.GetStopReason(now) != nullptr;
+                });
+        };
+
+        std::vector<Document> documents;
+        std::exception_ptr error;
+        if (!should_stop()) {
+            search_count_.fetch_add(1, std::memory_order_relaxed);
+            try {
+                const DocumentStatus status = group_begin->status;
+                documents = search_server_.FindTopDocuments(
+                    std::execution::seq, group_begin->raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+                        return document_status == status;
+                    }, TfIdfScorer{}, should_stop);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        const Clock::time_point now = Clock::now();
+        for (auto it = group_begin; it != group_end; ++it) {
+            if (const char* reason = it->GetStopReason(now)) {
+                it->result.set_exception(std::make_exception_ptr(QueryCancelled(reason)));
+            }
+            else if (error) {
+                it->result.set_exception(error);
+            }
+            else {
+                it->result.set_value(documents);
+            }
+        }
+        group_begin = group_end;
+    }
+}
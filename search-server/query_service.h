@@ -0,0 +1,105 @@
+#pragma once
+#include "search_server.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Thrown from QueryHandle::Get for queries that were cancelled or ran past
+// their deadline
+class QueryCancelled : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class QueryHandle {
+public:
+    QueryHandle(std::future<std::vector<Document>> result, std::shared_ptr<std::atomic<bool>> cancelled)
+        : result_(std::move(result))
+        , cancelled_(std::move(cancelled)) {
+    }
+
+    // Waits for the result, throws QueryCancelled if the query did not finish
+    std::vector<Document> Get() {
+        return result_.get();
+    }
+
+    std::future<std::vector<Document>>& GetFuture() {
+        return result_;
+    }
+
+    // A running query stops at the next block of postings
+    void Cancel() {
+        cancelled_->store(true, std::memory_order_relaxed);
+    }
+
+private:
+    std::future<std::vector<Document>> result_;
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+// Asynchronous front end of SearchServer: queries are queued and answered by
+// a fixed pool of worker threads. A worker takes up to max_batch_size queued
+// queries at once and runs identical ones only once.
+//
+// Worker i is bound to the CPUs of NUMA node worker_nodes[i % size], if any
+// are given (see BindCurrentThreadToNode).
+//
+// The server must outlive the service. Documents may be added, removed or
+// updated while it runs; each query sees the index before or after a change.
+class QueryService {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryService(const SearchServer& search_server, size_t thread_count, size_t max_batch_size = 16,
+        const std::vector<int>& worker_nodes = {});
+
+    // Queries still in the queue fail with QueryCancelled
+    ~QueryService();
+
+    QueryService(const QueryService&) = delete;
+    QueryService& operator=(const QueryService&) = delete;
+
+    // Zero timeout means no deadline
+    QueryHandle Submit(std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        Clock::duration timeout = Clock::duration::zero());
+
+    // While paused, queries are queued but no worker takes them. Deadlines
+    // keep running.
+    void Pause();
+
+    void Resume();
+
+    // Searches the workers ran; identical queries of a batch count once
+    uint64_t GetSearchCount() const;
+
+private:
+    struct PendingQuery {
+        std::string raw_query;
+        DocumentStatus status;
+        Clock::time_point deadline;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::promise<std::vector<Document>> result;
+
+        // Reason the query can't be answered, nullptr while it still can
+        const char* GetStopReason(Clock::time_point now) const;
+    };
+
+    const SearchServer& search_server_;
+    const size_t max_batch_size_;
+    std::deque<PendingQuery> queue_;
+    bool stopping_ = false;
+    bool paused_ = false;
+    std::atomic<uint64_t> search_count_ = 0;
+    std::mutex mutex_;
+    std::condition_variable queue_changed_;
+    std::vector<std::thread> workers_;
+
+    void RunWorker();
+
+    void ProcessBatch(std::vector<PendingQuery>& batch);
+};
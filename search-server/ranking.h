@@ -0,0 +1,62 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// Ranking models for SearchServer::FindTopDocuments. A model is a policy
+// type passed by value, so the scoring call is resolved at compile time and
+// inlined into the postings loop.
+//
+// A model provides:
+//   double InverseDocumentFreq(const CollectionStats& stats, size_t document_freq) const;
+//   double Score(double term_freq, int document_length, double inverse_document_freq) const;
+// where term_freq is the share of the document's words equal to the term,
+// as stored in the index.
+
+struct CollectionStats {
+    size_t document_count = 0;
+    double average_document_length = 0.0;
+};
+
+// Default model: relative term frequency times log(N / df)
+struct TfIdfScorer {
+    double InverseDocumentFreq(const CollectionStats& stats, size_t document_freq) const {
+        return std::log(stats.document_count * 1.0 / document_freq);
+    }
+
+    double Score(double term_freq, int /*document_length*/, double inverse_document_freq) const {
+        return term_freq * inverse_document_freq;
+    }
+};
+
+// Okapi BM25 with document length normalization
+struct Bm25Scorer {
+    double k1 = 1.2;
+    double b = 0.75;
+    // The length norm k1 * (1 - b + b * length / average length) is
+    // norm_base + norm_per_word * length. PrepareScorer sets both from
+    // CollectionStats once per query, so a posting costs no extra division.
+    double norm_base = 0.0;
+    double norm_per_word = 0.0;
+
+    double InverseDocumentFreq(const CollectionStats& stats, size_t document_freq) const {
+        return std::log(1.0 + (stats.document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    double Score(double term_freq, int document_length, double inverse_document_freq) const {
+        const double count = term_freq * document_length;
+        return inverse_document_freq * count * (k1 + 1.0) / (count + norm_base + norm_per_word * document_length);
+    }
+};
+
+// Lets a model read collection-wide values once per query
+template <typename Scorer>
+Scorer PrepareScorer(Scorer scorer, const CollectionStats& /*stats*/) {
+    return scorer;
+}
+
+inline Bm25Scorer PrepareScorer(Bm25Scorer scorer, const CollectionStats& stats) {
+    const double average_document_length = stats.average_document_length > 0.0 ? stats.average_document_length : 1.0;
+    scorer.norm_base = scorer.k1 * (1.0 - scorer.b);
+    scorer.norm_per_word = scorer.k1 * scorer.b / average_document_length;
+    return scorer;
+}
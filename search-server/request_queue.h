@@ -1,6 +1,7 @@
 #pragma once
 #include "search_server.h"
-#include <deque>
+#include <array>
+#include <atomic>
 
 class RequestQueue {
 public:
@@ -14,33 +15,21 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query);
     int GetNoResultRequests() const;
 private:
-    struct QueryResult {
-        std::string request;
-        bool answer_empty;
-    };
-    std::deque<QueryResult> requests_;
     const static int min_in_day_ = 1440;
     const SearchServer& search_server_;
-    int count_request_in_day_ = 0;
-    int answer_empty_ = 0;
+    // Ring buffer over the last min_in_day_ requests: whether request i found
+    // nothing is kept in slot i % min_in_day_
+    std::array<std::atomic<bool>, min_in_day_> empty_results_{};
+    std::atomic<uint64_t> request_count_ = 0;
+    std::atomic<int> answer_empty_ = 0;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
     std::vector<Document> documents = search_server_.FindTopDocuments(raw_query, document_predicate);
-    if (count_request_in_day_ == min_in_day_) {
-        if (requests_.front().answer_empty) {
-            --answer_empty_;
-            requests_.pop_front();
-        }
-    }
-    else {
-        ++count_request_in_day_;
-    }
-    requests_.push_back({ raw_query, documents.empty() });
-
-    if (documents.empty()) {
-        ++answer_empty_;
-    }
+    const bool answer_empty = documents.empty();
+    const uint64_t request_index = request_count_.fetch_add(1);
+    const bool replaced_empty = empty_results_[request_index % min_in_day_].exchange(answer_empty);
+    answer_empty_ += static_cast<int>(answer_empty) - static_cast<int>(replaced_empty);
     return documents;
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+#include "search_server.h"
+#include "paginator.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+// Returns the results of a query page by page, without the
+// MAX_RESULT_DOCUMENT_COUNT limit of FindTopDocuments. Between pages the
+// cursor keeps only the query and the last document returned. Every page
+// scores the query again and keeps, in a heap of page_size documents, the
+// best of those ranked after that document.
+//
+// Documents are ranked as in FindTopDocuments, except that relevances are
+// compared at epsilon resolution and the remaining ties are ordered by id,
+// so that pages never overlap or skip documents. NextPage throws
+// std::logic_error once documents are added to, removed from or updated in
+// the server. The server must outlive the cursor.
+template <typename DocumentPredicate>
+class SearchCursor {
+public:
+    SearchCursor(const SearchServer& search_server, std::string raw_query, DocumentPredicate document_predicate, size_t page_size)
+        : search_server_(search_server)
+        , raw_query_(std::move(raw_query))
+        , document_predicate_(document_predicate)
+        , page_size_(page_size) {
+        if (page_size_ == 0) {
+            throw std::invalid_argument("Page size must be positive");
+        }
+        std::shared_lock lock(search_server_.index_mutex_);
+        // Rejects invalid queries before the first page
+        search_server_.ParseQuery(raw_query_);
+        generation_ = search_server_.generation_;
+    }
+
+    // Empty once all documents have been returned
+    std::vector<Document> NextPage() {
+        if (exhausted_) {
+            return {};
+        }
+        std::vector<Document> page;
+        size_t remaining_count = 0;
+        {
+            std::shared_lock lock(search_server_.index_mutex_);
+            if (search_server_.generation_ != generation_) {
+                throw std::logic_error("Server changed after the search cursor was opened");
+            }
+            // Terms of the parsed query point into the index, so it is not kept
+            const SearchServer::Query query = search_server_.ParseQuery(raw_query_);
+            const std::vector<Document> documents = search_server_.FindAllDocuments(
+                std::execution::seq, query, document_predicate_, TfIdfScorer{}, NeverStop{});
+
+            PROFILE_PHASE(Phase::TOP_K);
+            page.reserve(std::min(page_size_, documents.size()));
+            // A heap whose front is the document ranked last on the page
+            for (const Document& document : documents) {
+                if (last_returned_ && !IsRankedBefore(*last_returned_, document)) {
+                    continue;
+                }
+                ++remaining_count;
+                if (page.size() < page_size_) {
+                    page.push_back(document);
+                    std::push_heap(page.begin(), page.end(), IsRankedBefore);
+                }
+                else if (IsRankedBefore(document, page.front())) {
+                    std::pop_heap(page.begin(), page.end(), IsRankedBefore);
+                    page.back() = document;
+                    std::push_heap(page.begin(), page.end(), IsRankedBefore);
+                }
+            }
+        }
+        std::sort_heap(page.begin(), page.end(), IsRankedBefore);
+        exhausted_ = remaining_count <= page_size_;
+        if (!page.empty()) {
+            last_returned_ = page.back();
+        }
+        return page;
+    }
+
+    bool IsExhausted() const {
+        return exhausted_;
+    }
+
+private:
+    const SearchServer& search_server_;
+    std::string raw_query_;
+    DocumentPredicate document_predicate_;
+    size_t page_size_;
+    uint64_t generation_ = 0;
+    // Pages hold the documents ranked after it
+    std::optional<Document> last_returned_;
+    bool exhausted_ = false;
+
+    // A strict weak ordering, unlike comparing relevances with epsilon
+    static bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+        const long long lhs_relevance = std::llround(lhs.relevance / epsilon);
+        const long long rhs_relevance = std::llround(rhs.relevance / epsilon);
+        if (lhs_relevance != rhs_relevance) {
+            return lhs_relevance > rhs_relevance;
+        }
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+};
+
+struct DocumentStatusPredicate {
+    DocumentStatus status;
+
+    bool operator()(int document_id, DocumentStatus document_status, int rating) const {
+        return document_status == status;
+    }
+};
+
+template <typename DocumentPredicate>
+SearchCursor<DocumentPredicate> OpenSearchCursor(const SearchServer& search_server, std::string raw_query,
+    DocumentPredicate document_predicate, size_t page_size) {
+    return SearchCursor<DocumentPredicate>(search_server, std::move(raw_query), document_predicate, page_size);
+}
+
+inline SearchCursor<DocumentStatusPredicate> OpenSearchCursor(const SearchServer& search_server, std::string raw_query,
+    DocumentStatus status, size_t page_size) {
+    return OpenSearchCursor(search_server, std::move(raw_query), DocumentStatusPredicate{ status }, page_size);
+}
+
+inline SearchCursor<DocumentStatusPredicate> OpenSearchCursor(const SearchServer& search_server, std::string raw_query, size_t page_size) {
+    return OpenSearchCursor(search_server, std::move(raw_query), DocumentStatus::ACTUAL, page_size);
+}
+
+// Pages are fetched from the cursor one at a time while iterating
+template <typename DocumentPredicate>
+auto Paginate(SearchCursor<DocumentPredicate>& cursor) {
+    return CursorPaginator(cursor);
+}
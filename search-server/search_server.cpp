@@ -1,28 +1,126 @@
 #include "search_server.h"
 #include <cmath>
+#include <limits>
 #include <execution>
 
 void SearchServer::AddDocument(int document_id, const std::string_view & document, DocumentStatus status, const std::vector<int>&ratings) {
     if (document_id <= INVALID_DOCUMENT_ID) {
         throw std::invalid_argument("ID can't be a negative number");
     }
-    else if (documents_.count(document_id)) {
+    AddDocument(document_id, ComputeDocumentWords(document), status, ratings);
+}
+
+void SearchServer::AddDocument(int document_id, const DocumentWords& words, DocumentStatus status, const std::vector<int>& ratings) {
+    if (document_id <= INVALID_DOCUMENT_ID) {
+        throw std::invalid_argument("ID can't be a negative number");
+    }
+    std::unique_lock lock(index_mutex_);
+    if (documents_.count(document_id)) {
         throw std::invalid_argument("ID already added");
     }
+    documents_.emplace(document_id, SearchServer::DocumentData{ComputeAverageRating(ratings), status, 0});
+    ReplaceDocumentWords(document_id, words);
+    documents_input_.push_back(document_id);
+    ++generation_;
+}
+
+void SearchServer::UpdateDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings) {
+    const DocumentWords words = ComputeDocumentWords(document);
+    std::unique_lock lock(index_mutex_);
+    auto it_document = documents_.find(document_id);
+    if (it_document == documents_.end()) {
+        throw std::invalid_argument("ID isn't added");
+    }
+    it_document->second.status = status;
+    it_document->second.rating = ComputeAverageRating(ratings);
+    ReplaceDocumentWords(document_id, words);
+    ++generation_;
+}
+
+void SearchServer::UpdateDocuments(const std::vector<DocumentUpdate>& updates) {
+    std::vector<std::optional<DocumentWords>> updates_words(updates.size());
+    for (size_t i = 0; i < updates.size(); ++i) {
+        if (updates[i].text) {
+            updates_words[i] = ComputeDocumentWords(*updates[i].text);
+        }
+    }
+
+    std::unique_lock lock(index_mutex_);
+    for (const DocumentUpdate& update : updates) {
+        if (!documents_.count(update.document_id)) {
+            throw std::invalid_argument("ID isn't added");
+        }
+    }
+    for (size_t i = 0; i < updates.size(); ++i) {
+        const DocumentUpdate& update = updates[i];
+        DocumentData& document_data = documents_.at(update.document_id);
+        if (update.status) {
+            document_data.status = *update.status;
+        }
+        if (update.ratings) {
+            document_data.rating = ComputeAverageRating(*update.ratings);
+        }
+        if (updates_words[i]) {
+            ReplaceDocumentWords(update.document_id, *updates_words[i]);
+        }
+    }
+    ++generation_;
+}
+
+SearchServer::DocumentWords SearchServer::ComputeDocumentWords(const std::string_view& document) const {
     const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
     const double inv_word_count = 1.0 / words.size();
+    DocumentWords result;
     for (const auto& word : words) {
         if (!IsValidWord(word)) {
             throw std::invalid_argument("Word is'nt valid (documaent)");
         }
-        std::string str = static_cast<std::string>(word);
-        std::string_view str_view = str;
-        word_to_document_freqs_[std::move(str)][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][str_view] += inv_word_count;
+        result.freqs[word] += inv_word_count;
     }
-    
-    documents_.emplace(document_id, SearchServer::DocumentData{ComputeAverageRating(ratings), status});
-    documents_input_.push_back(document_id);
+    result.word_count = static_cast<int>(words.size());
+    return result;
+}
+
+void SearchServer::ReplaceDocumentWords(int document_id, const DocumentWords& words) {
+    WordFrequencies& word_freqs = document_to_word_freqs_[document_id];
+    // Both maps are ordered by word, so one merge pass finds the words that
+    // left the document, the words that are new to it and the changed ones
+    auto it_old = word_freqs.begin();
+    auto it_new = words.freqs.begin();
+    while (it_old != word_freqs.end() || it_new != words.freqs.end()) {
+        if (it_new == words.freqs.end() || (it_old != word_freqs.end() && it_old->first < it_new->first)) {
+            // The view points at the key of word_to_document_freqs_, so that key goes last
+            const std::string_view word = it_old->first;
+            auto it_word = word_to_document_freqs_.find(word);
+            it_word->second.erase(document_id);
+            it_old = word_freqs.erase(it_old);
+            if (it_word->second.empty()) {
+                term_index_.Remove(word);
+                word_to_document_freqs_.erase(it_word);
+            }
+        }
+        else if (it_old == word_freqs.end() || it_new->first < it_old->first) {
+            auto [it_word, inserted] = word_to_document_freqs_.try_emplace(static_cast<std::string>(it_new->first));
+            if (inserted) {
+                term_index_.Insert(it_word->first);
+            }
+            it_word->second[document_id] = it_new->second;
+            word_freqs.emplace_hint(it_old, it_word->first, it_new->second);
+            ++it_new;
+        }
+        else {
+            if (it_old->second != it_new->second) {
+                word_to_document_freqs_.find(it_old->first)->second.at(document_id) = it_new->second;
+                it_old->second = it_new->second;
+            }
+            ++it_old;
+            ++it_new;
+        }
+    }
+
+    DocumentData& document_data = documents_.at(document_id);
+    total_word_count_ = total_word_count_ - document_data.word_count + words.word_count;
+    document_data.word_count = words.word_count;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view & raw_query, DocumentStatus status) const {
@@ -37,10 +135,12 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw
 }
 
 size_t SearchServer::GetDocumentCount() const {
+    std::shared_lock lock(index_mutex_);
     return documents_.size();
 }
 
 int SearchServer::GetDocumentId(int index) const {
+    std::shared_lock lock(index_mutex_);
     return documents_input_.at(index);
 }
 
@@ -72,8 +172,126 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const
     return SearchServer::ParseQuery(std::execution::seq, text);
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string& word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+SearchServer::ExpandedQuery SearchServer::ExpandQuery(const std::string_view& text) const {
+    ExpandedQuery query;
+    {
+        PROFILE_PHASE(Phase::QUERY_PARSE);
+        for (const auto& word : SplitIntoWords(text)) {
+            const QueryWord query_word = SearchServer::ParseQueryWord(word);
+            if (!query_word.is_stop) {
+                if (!IsValidWord(query_word.data)) {
+                    throw std::invalid_argument("Word is'nt valid (find)");
+                }
+                if (query_word.is_minus) {
+                    if (query_word.data.empty() || query_word.data[0] == '-') {
+                        throw std::invalid_argument("Word have ""-"" in begin or empty (find)");
+                    }
+                    query.minus_words.push_back({ query_word.data, {} });
+                }
+                else {
+                    query.plus_words.push_back({ query_word.data, {} });
+                }
+            }
+        }
+    }
+
+    PROFILE_PHASE(Phase::TERM_RESOLVE);
+    // A capped minus word would leave some of its documents in the results
+    for (ExpandedWord& expanded_word : query.minus_words) {
+        AppendQueryTerms(expanded_word.word, std::numeric_limits<size_t>::max(), expanded_word.terms);
+    }
+    for (ExpandedWord& expanded_word : query.plus_words) {
+        AppendQueryTerms(expanded_word.word, max_term_expansions_, expanded_word.terms);
+    }
+    return query;
+}
+
+void SearchServer::AppendQueryTerms(const std::string_view& word, size_t max_count, std::vector<std::string_view>& terms) const {
+    // Indexed words like "c*" or "a~1" can still be searched as written
+    if (FindPostings(word) != nullptr) {
+        terms.push_back(word);
+        return;
+    }
+
+    if (word.size() > 1 && word.back() == '*') {
+        const auto expansions = term_index_.FindByPrefix(word.substr(0, word.size() - 1), max_count);
+        terms.insert(terms.end(), expansions.begin(), expansions.end());
+        return;
+    }
+
+    const size_t tilde = word.rfind('~');
+    const std::string_view distance = tilde == word.npos ? std::string_view() : word.substr(tilde + 1);
+    if (tilde == 0 || tilde == word.npos || !(distance.empty() || distance == "1" || distance == "2")) {
+        terms.push_back(word);
+        return;
+    }
+    const int max_distance = distance.empty() ? 2 : distance[0] - '0';
+    const auto expansions = term_index_.FindFuzzy(word.substr(0, tilde), max_distance, max_count);
+    terms.insert(terms.end(), expansions.begin(), expansions.end());
+}
+
+void SearchServer::SetMaxTermExpansions(size_t max_count) {
+    std::unique_lock lock(index_mutex_);
+    max_term_expansions_ = max_count;
+    // Results of the same query change, so cursors must not continue
+    ++generation_;
+}
+
+bool SearchServer::ContainsAnyTerm(const ExpandedWord& expanded_word, int document_id) const {
+    return std::any_of(expanded_word.terms.begin(), expanded_word.terms.end(), [&](const std::string_view& term) {
+        const Postings* postings = FindPostings(term);
+        return postings != nullptr && postings->count(document_id);
+        });
+}
+
+const SearchServer::Postings* SearchServer::FindPostings(const std::string_view& word) const {
+    const auto it = word_to_document_freqs_.find(word);
+    if (it == word_to_document_freqs_.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+CollectionStats SearchServer::GetCollectionStats() const {
+    CollectionStats stats;
+    // Called with the lock held, so not through GetDocumentCount
+    stats.document_count = documents_.size();
+    if (stats.document_count > 0) {
+        stats.average_document_length = total_word_count_ * 1.0 / stats.document_count;
+    }
+    return stats;
+}
+
+std::vector<const SearchServer::Postings*> SearchServer::ResolvePostings(const std::vector<std::string_view>& words) const {
+    PROFILE_PHASE(Phase::TERM_RESOLVE);
+    std::vector<const Postings*> postings;
+    postings.reserve(words.size());
+    for (const std::string_view& word : words) {
+        const Postings* word_postings = FindPostings(word);
+        if (word_postings != nullptr && !word_postings->empty()) {
+            postings.push_back(word_postings);
+        }
+    }
+    return postings;
+}
+
+std::vector<int> SearchServer::BuildExcludedDocuments(const Query& query) const {
+    PROFILE_PHASE(Phase::EXCLUSION);
+    std::vector<int> excluded_documents;
+    for (const std::string_view& word : query.minus_words) {
+        const Postings* postings = FindPostings(word);
+        if (postings == nullptr) {
+            continue;
+        }
+        for (const auto [document_id, _] : *postings) {
+            excluded_documents.push_back(document_id);
+        }
+    }
+    if (query.minus_words.size() > 1) {
+        std::sort(excluded_documents.begin(), excluded_documents.end());
+        excluded_documents.erase(std::unique(excluded_documents.begin(), excluded_documents.end()), excluded_documents.end());
+    }
+    return excluded_documents;
 }
 
 bool SearchServer::IsValidWord(const std::string_view& word) {
@@ -91,7 +309,8 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
+const SearchServer::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
+    std::shared_lock lock(index_mutex_);
     return document_to_word_freqs_.at(document_id);
 }
 
@@ -103,6 +322,100 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     return SearchServer::MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
+DocumentMatches SearchServer::MatchDocuments(const std::string_view& raw_query, const std::vector<int>& document_ids) const {
+    std::shared_lock lock(index_mutex_);
+    const ExpandedQuery query = ExpandQuery(raw_query);
+
+    // Words as written, sorted and without repeats like the words of MatchDocument
+    std::vector<const ExpandedWord*> plus_words;
+    for (const ExpandedWord& expanded_word : query.plus_words) {
+        plus_words.push_back(&expanded_word);
+    }
+    std::sort(plus_words.begin(), plus_words.end(), [](const ExpandedWord* lhs, const ExpandedWord* rhs) {
+        return lhs->word < rhs->word;
+        });
+    plus_words.erase(std::unique(plus_words.begin(), plus_words.end(), [](const ExpandedWord* lhs, const ExpandedWord* rhs) {
+        return lhs->word == rhs->word;
+        }), plus_words.end());
+
+    DocumentMatches result;
+    for (const ExpandedWord* expanded_word : plus_words) {
+        result.terms.push_back(expanded_word->word);
+    }
+    result.mask_word_count = (result.terms.size() + 63) / 64;
+    result.masks.assign(document_ids.size() * result.mask_word_count, 0);
+    result.statuses.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        const auto it = documents_.find(document_id);
+        if (it == documents_.end()) {
+            throw std::out_of_range("Out of range"s);
+        }
+        result.statuses.push_back(it->second.status);
+    }
+
+    // Requested ids with their positions in the result, by id
+    std::vector<std::pair<int, size_t>> requests(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        requests[i] = { document_ids[i], i };
+    }
+    std::sort(requests.begin(), requests.end());
+
+    // Calls action(position) for every requested document in the postings
+    const auto for_each_requested = [&requests](const Postings& postings, auto action) {
+        // Probing is cheaper than a full merge when the postings are much longer
+        if (requests.size() * 16 < postings.size()) {
+            for (const auto& [document_id, position] : requests) {
+                if (postings.count(document_id)) {
+                    action(position);
+                }
+            }
+            return;
+        }
+        auto it_postings = postings.begin();
+        for (const auto& [document_id, position] : requests) {
+            while (it_postings != postings.end() && it_postings->first < document_id) {
+                ++it_postings;
+            }
+            if (it_postings == postings.end()) {
+                return;
+            }
+            if (it_postings->first == document_id) {
+                action(position);
+            }
+        }
+    };
+
+    for (size_t term_index = 0; term_index < plus_words.size(); ++term_index) {
+        const uint64_t bit = uint64_t{ 1 } << (term_index % 64);
+        const size_t word = term_index / 64;
+        for (const Postings* postings : ResolvePostings(plus_words[term_index]->terms)) {
+            for_each_requested(*postings, [&](size_t position) {
+                result.masks[position * result.mask_word_count + word] |= bit;
+                });
+        }
+    }
+
+    for (const ExpandedWord& expanded_word : query.minus_words) {
+        for (const Postings* postings : ResolvePostings(expanded_word.terms)) {
+            for_each_requested(*postings, [&](size_t position) {
+                const auto mask = result.masks.begin() + position * result.mask_word_count;
+                std::fill(mask, mask + result.mask_word_count, 0);
+                });
+        }
+    }
+    return result;
+}
+
+std::vector<std::string_view> DocumentMatches::GetMatchedTerms(size_t document_index) const {
+    std::vector<std::string_view> matched_terms;
+    for (size_t term_index = 0; term_index < terms.size(); ++term_index) {
+        if (IsMatched(document_index, term_index)) {
+            matched_terms.push_back(terms[term_index]);
+        }
+    }
+    return matched_terms;
+}
+
 std::vector<int>::iterator  SearchServer::begin() {
     return documents_input_.begin();
 }
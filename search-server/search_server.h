@@ -8,29 +8,114 @@
 #include <iterator>
 #include <execution>
 #include <string_view>
+#include <optional>
+#include <shared_mutex>
 #include "concurrent_map.h"
+#include "term_index.h"
+#include "ranking.h"
+#include "instrumentation.h"
+#include "index_memory.h"
 
 
 using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+const size_t MAX_TERM_EXPANSION_COUNT = 64;
 const double epsilon = 1e-6;
+// Postings scored between two checks of a stop condition
+const size_t POSTING_BLOCK_SIZE = 1024;
 
+// Stop condition of queries that always run to completion
+struct NeverStop {
+    bool operator()() const {
+        return false;
+    }
+};
+
+// Result of SearchServer::MatchDocuments. Documents are in the order they
+// were requested; each has a bitmask over terms of mask_word_count words.
+// Terms are the plus words of the query as written, so they point into the
+// query string like the words MatchDocument returns.
+struct DocumentMatches {
+    std::vector<std::string_view> terms;
+    size_t mask_word_count = 0;
+    std::vector<uint64_t> masks;
+    std::vector<DocumentStatus> statuses;
+
+    bool IsMatched(size_t document_index, size_t term_index) const {
+        return (masks[document_index * mask_word_count + term_index / 64] >> (term_index % 64)) & 1;
+    }
+
+    // Same words as MatchDocument returns for the document
+    std::vector<std::string_view> GetMatchedTerms(size_t document_index) const;
+};
+
+// One change of SearchServer::UpdateDocuments; fields left empty keep their value
+struct DocumentUpdate {
+    int document_id = 0;
+    std::optional<std::string> text;
+    std::optional<DocumentStatus> status;
+    std::optional<std::vector<int>> ratings;
+};
+
+template <typename DocumentPredicate>
+class SearchCursor;
+
+// Queries may run concurrently with AddDocument, RemoveDocument and the
+// updates: changes take an exclusive lock, queries and the accessors below
+// a shared one, unless noted otherwise. The lock makes the server neither
+// copyable nor movable.
 class SearchServer {
+    friend class ImpactIndex;
+    template <typename DocumentPredicate>
+    friend class SearchCursor;
+
 public:
+    // Index containers allocate from the resource given to the constructor
+    using Postings = std::pmr::map<int, double>;
+    // Returned by GetWordFrequencies, so it keeps the standard allocator
+    using WordFrequencies = std::map<std::string_view, double>;
+
     inline static constexpr int INVALID_DOCUMENT_ID = -1;
 
+    // The index is allocated from memory_resource, which must outlive the
+    // server; see index_memory.h
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    explicit SearchServer(const StringContainer& stop_words,
+        std::pmr::memory_resource* memory_resource = &IndexMemoryResource::Instance());
 
-    explicit SearchServer(const std::string& stop_words_text)
+    explicit SearchServer(const std::string& stop_words_text,
+        std::pmr::memory_resource* memory_resource = &IndexMemoryResource::Instance())
         : SearchServer(
-            SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+            SplitIntoWords(stop_words_text), memory_resource)  // Invoke delegating constructor from string container
     {
     }
 
+    // Words of a document text and their frequencies. They point into the
+    // text, which must outlive them.
+    struct DocumentWords {
+        std::map<std::string_view, double> freqs;
+        int word_count = 0;
+    };
+
+    // Splits the text and drops stop words without locking or changing the
+    // index, so it may run on any thread. Throws for invalid words.
+    DocumentWords ComputeDocumentWords(const std::string_view& document) const;
+
     void AddDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // AddDocument with words computed beforehand: only the merge into the
+    // index runs under the exclusive lock
+    void AddDocument(int document_id, const DocumentWords& words, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Replaces the text, status and rating of an added document in place.
+    // Only the postings of words whose frequency changed are touched.
+    void UpdateDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // All updates are checked before any is applied, and they are applied under
+    // one exclusive lock, so queries see either none or all of them
+    void UpdateDocuments(const std::vector<DocumentUpdate>& updates);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const;
 
@@ -47,37 +132,74 @@ public:
     template <typename Execution>
     std::vector<Document> FindTopDocuments(Execution _Exec, const std::string_view& raw_query) const;
 
+    // Ranks with the given model from ranking.h instead of TF-IDF
+    template <typename Execution, typename DocumentPredicate, typename Scorer>
+    std::vector<Document> FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentPredicate document_predicate, const Scorer& scorer) const;
+
+    template <typename Execution, typename Scorer>
+    std::vector<Document> FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentStatus status, const Scorer& scorer) const;
+
+    // Scoring ends early, with the documents scored so far, once should_stop()
+    // returns true. It is checked before each query word and after every
+    // POSTING_BLOCK_SIZE postings.
+    template <typename Execution, typename DocumentPredicate, typename Scorer, typename StopCondition>
+    std::vector<Document> FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentPredicate document_predicate,
+        const Scorer& scorer, StopCondition should_stop) const;
+
 
     size_t GetDocumentCount() const;
 
+    // Returned words point into raw_query. A "prefix*" or "word~N" word is
+    // returned as written when any of the terms it expands to is in the document.
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query, int document_id) const;
 
     template <typename Execution>
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(Execution _Exec, const std::string_view& raw_query, int document_id) const;
 
+    // MatchDocument for many documents: the query is parsed and its terms are
+    // looked up once, then every posting list is merged with the sorted ids
+    DocumentMatches MatchDocuments(const std::string_view& raw_query, const std::vector<int>& document_ids) const;
+
     int GetDocumentId(int index) const;
 
+    // Not synchronized: iterate only while no other thread changes the server
     std::vector<int>::iterator begin();
 
     std::vector<int>::iterator end() ;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // The reference stays valid until the document is updated or removed;
+    // read it only while no other thread changes that document
+    const WordFrequencies& GetWordFrequencies(int document_id) const;
     
     void RemoveDocument(int document_id);
 
     template <typename Execution>
     void RemoveDocument(Execution&& _Exec, int document_id);
+
+    // Limits how many index terms a single "prefix*" or "word~N" plus word
+    // expands to; minus words always exclude every term they match
+    void SetMaxTermExpansions(size_t max_count);
     
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        int word_count;
     };
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    std::pmr::map<std::string, Postings, std::less<>> word_to_document_freqs_;
+    std::pmr::map<int, WordFrequencies> document_to_word_freqs_;
+    std::pmr::map<int, DocumentData> documents_;
     std::vector<int> documents_input_;
+    size_t total_word_count_ = 0;
+    TermIndex term_index_;
+    size_t max_term_expansions_ = MAX_TERM_EXPANSION_COUNT;
+    // Held exclusively while the index changes and shared by queries
+    mutable std::shared_mutex index_mutex_;
+    // Incremented by every change of the index or of max_term_expansions_,
+    // under the exclusive lock; lets snapshots of the index detect that they
+    // are out of date
+    uint64_t generation_ = 0;
  
     bool IsStopWord(const std::string_view& word) const;
 
@@ -87,6 +209,10 @@ private:
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // Brings the postings of the document in line with words, leaving the
+    // postings of unchanged words as they are
+    void ReplaceDocumentWords(int document_id, const DocumentWords& words);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
@@ -102,26 +228,61 @@ private:
 
     Query ParseQuery(const std::string_view& text) const;
 
+    // A query word as written, without the minus, and the terms it stands for
+    struct ExpandedWord {
+        std::string_view word;
+        std::vector<std::string_view> terms;
+    };
+
+    struct ExpandedQuery {
+        std::vector<ExpandedWord> plus_words;
+        std::vector<ExpandedWord> minus_words;
+    };
+
+    // Terms point into the index and are only valid until it changes
+    ExpandedQuery ExpandQuery(const std::string_view& text) const;
+
+    // Appends the index terms the query word stands for: "prefix*" expands to
+    // the terms with that prefix, "word~" and "word~N" (N is 1 or 2) to the terms
+    // within N edits (2 by default). Any other word, and a word that is in the
+    // index as written, stands for itself.
+    void AppendQueryTerms(const std::string_view& word, size_t max_count, std::vector<std::string_view>& terms) const;
+
+    // True when the document contains one of the terms of the word
+    bool ContainsAnyTerm(const ExpandedWord& expanded_word, int document_id) const;
+
     template <typename Execution>
     Query ParseQuery(Execution _Exec, const std::string_view& text) const;
  
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    // Returns nullptr for words that are not in the index
+    const Postings* FindPostings(const std::string_view& word) const;
+
+    // Non-empty posting lists of the words that are in the index
+    std::vector<const Postings*> ResolvePostings(const std::vector<std::string_view>& words) const;
+
+    CollectionStats GetCollectionStats() const;
+
+    // Sorted ids of the documents that contain one of the minus words; its
+    // size is bounded by the minus postings, not by the largest document id
+    std::vector<int> BuildExcludedDocuments(const Query& query) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query,
         DocumentPredicate document_predicate) const;
     
-    template <typename Execution, typename DocumentPredicate>
+    template <typename Execution, typename DocumentPredicate, typename Scorer, typename StopCondition>
     std::vector<Document> FindAllDocuments(Execution&& _Exec, const Query& query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, const Scorer& scorer, StopCondition should_stop) const;
 
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+SearchServer::SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* memory_resource)
+    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , word_to_document_freqs_(memory_resource)
+    , document_to_word_freqs_(memory_resource)
+    , documents_(memory_resource) {
     if (!std::all_of(stop_words_.begin(), stop_words_.end(), SearchServer::IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid"s);
     }
@@ -130,46 +291,64 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
     DocumentPredicate document_predicate) const {
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
+    return FindAllDocuments(std::execution::seq, query, document_predicate, TfIdfScorer{}, NeverStop{});
 }
 
-template <typename Execution, typename DocumentPredicate>
+template <typename Execution, typename DocumentPredicate, typename Scorer, typename StopCondition>
 std::vector<Document> SearchServer::FindAllDocuments(Execution&& _Exec, const Query& query,
-    DocumentPredicate document_predicate) const {
+    DocumentPredicate document_predicate, const Scorer& scorer, StopCondition should_stop) const {
+    const CollectionStats stats = GetCollectionStats();
+    const Scorer query_scorer = PrepareScorer(scorer, stats);
+
+    const std::vector<int> excluded_documents = BuildExcludedDocuments(query);
+
+    const std::vector<const Postings*> plus_postings = ResolvePostings(query.plus_words);
+
     ConcurrentMap<int, double> cm_document_to_relevance(8);
-    std::for_each(_Exec, query.plus_words.begin(), query.plus_words.end(),
-        [&](const std::string_view& word) {
-            if (word_to_document_freqs_.count(static_cast<std::string>(word)) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(static_cast<std::string>(word));
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
+    {
+        PROFILE_PHASE(Phase::POSTINGS_SCAN);
+        std::for_each(_Exec, plus_postings.begin(), plus_postings.end(),
+            [&](const Postings* postings) {
+                if (should_stop()) {
+                    return;
+                }
+                PROFILE_COUNT(Counter::POSTINGS_SCANNED, postings->size());
+                const double inverse_document_freq = query_scorer.InverseDocumentFreq(stats, postings->size());
+                size_t scanned_count = 0;
+                // Postings are ordered by id, so the excluded ids are walked along with them
+                auto it_excluded = excluded_documents.begin();
+                for (const auto [document_id, term_freq] : *postings) {
+                    if (++scanned_count % POSTING_BLOCK_SIZE == 0 && should_stop()) {
+                        return;
+                    }
+                    while (it_excluded != excluded_documents.end() && *it_excluded < document_id) {
+                        ++it_excluded;
+                    }
+                    if (it_excluded != excluded_documents.end() && *it_excluded == document_id) {
+                        continue;
+                    }
                     const auto& document_data = documents_.at(document_id);
                     if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        cm_document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                        cm_document_to_relevance[document_id] += query_scorer.Score(term_freq, document_data.word_count, inverse_document_freq);
                     }
                 }
-            }
-        });
-
-    std::for_each(_Exec, query.minus_words.begin(), query.minus_words.end(),
-        [&](const std::string_view& word) {
-            if (word_to_document_freqs_.count(static_cast<std::string>(word)) != 0) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
-                    cm_document_to_relevance.erase(document_id);
-                }
-            }
-        });
+            });
+    }
 
+    PROFILE_PHASE(Phase::RESULT_BUILD);
     std::vector<Document> matched_documents;
     for (const auto [document_id, relevance] : cm_document_to_relevance.BuildOrdinaryMap()) {
         matched_documents.push_back(
             { document_id, relevance, documents_.at(document_id).rating });
     }
+    PROFILE_COUNT(Counter::CANDIDATES, matched_documents.size());
     return matched_documents;
 }
 
 
 template <typename Execution>
 void SearchServer::RemoveDocument(Execution&& _Exec, int document_id) {
+    std::unique_lock lock(index_mutex_);
     auto it_input = std::find(documents_input_.begin(), documents_input_.end(), document_id);
     if (it_input != documents_input_.end()) {
 
@@ -189,30 +368,29 @@ void SearchServer::RemoveDocument(Execution&& _Exec, int document_id) {
         documents.erase(document_id);
             }
         );
+        for (const std::string_view& word : vector_words) {
+            auto it_word = word_to_document_freqs_.find(word);
+            if (it_word->second.empty()) {
+                term_index_.Remove(word);
+                word_to_document_freqs_.erase(it_word);
+            }
+        }
+        total_word_count_ -= documents_.at(document_id).word_count;
         documents_.erase(document_id);
         document_to_word_freqs_.erase(document_id);
+        ++generation_;
     }
 }
 
 template <typename Execution>
 SearchServer::Query SearchServer::ParseQuery(Execution _Exec, const std::string_view& text) const {
+    const ExpandedQuery expanded_query = ExpandQuery(text);
     Query query;
-    for (const auto& word : SplitIntoWords(text)) {
-        const QueryWord query_word = SearchServer::ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (!IsValidWord(query_word.data)) {
-                throw std::invalid_argument("Word is'nt valid (find)");
-            }
-            if (query_word.is_minus) {
-                if (query_word.data.empty() || query_word.data[0] == '-') {
-                    throw std::invalid_argument("Word have ""-"" in begin or empty (find)");
-                }
-                query.minus_words.push_back(query_word.data);
-            }
-            else {
-                query.plus_words.push_back(query_word.data);
-            }
-        }
+    for (const ExpandedWord& expanded_word : expanded_query.plus_words) {
+        query.plus_words.insert(query.plus_words.end(), expanded_word.terms.begin(), expanded_word.terms.end());
+    }
+    for (const ExpandedWord& expanded_word : expanded_query.minus_words) {
+        query.minus_words.insert(query.minus_words.end(), expanded_word.terms.begin(), expanded_word.terms.end());
     }
     if constexpr (std::is_same_v
         <Execution,
@@ -232,47 +410,48 @@ SearchServer::Query SearchServer::ParseQuery(Execution _Exec, const std::string_
 
 template <typename Execution>
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(Execution _Exec, const std::string_view& raw_query, int document_id) const {
-    const Query query = SearchServer::ParseQuery(_Exec, raw_query);
+    std::shared_lock lock(index_mutex_);
+    const ExpandedQuery query = ExpandQuery(raw_query);
     std::vector < std::string_view > matched_words;
     if (std::find(documents_input_.begin(), documents_input_.end(), document_id) == documents_input_.end()) {
         throw std::out_of_range("Out of range"s);
     }
+    const auto contains = [&](const ExpandedWord& expanded_word) {
+        return ContainsAnyTerm(expanded_word, document_id);
+    };
     if constexpr (std::is_same_v
         <Execution,
         std::execution::parallel_policy>) {
-        if (std::any_of(_Exec, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view& word) {
-            return word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id);
-            })) {
+        if (std::any_of(_Exec, query.minus_words.begin(), query.minus_words.end(), contains)) {
             return { matched_words, documents_.at(document_id).status };
         }
  
-        matched_words.resize(query.plus_words.size());
-        auto it = std::copy_if(_Exec, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&](const std::string_view& word) {
-            return word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id);
+        std::vector<const ExpandedWord*> matched(query.plus_words.size());
+        auto it = std::transform(_Exec, query.plus_words.begin(), query.plus_words.end(), matched.begin(), [&](const ExpandedWord& expanded_word) {
+            return contains(expanded_word) ? &expanded_word : nullptr;
             });
-        matched_words.erase(it, matched_words.end());
-        std::sort(_Exec,matched_words.begin(), matched_words.end());
-        auto it_unique = std::unique(_Exec, matched_words.begin(), matched_words.end());
-        matched_words.erase(it_unique, matched_words.end());
- 
+        for (auto it_matched = matched.begin(); it_matched != it; ++it_matched) {
+            if (*it_matched != nullptr) {
+                matched_words.push_back((*it_matched)->word);
+            }
+        }
     }
     else {
-        for (const std::string_view& word : query.minus_words) {
-             if (word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id)) {
+        for (const ExpandedWord& expanded_word : query.minus_words) {
+            if (contains(expanded_word)) {
                 return { matched_words, documents_.at(document_id).status };
             }
         }
 
-        for (const std::string_view& word : query.plus_words) {
-            if (word_to_document_freqs_.count(static_cast<std::string>(word)) == 0) {
-                continue;
-            }
-            if (word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id)) {
-                matched_words.push_back(word);
+        for (const ExpandedWord& expanded_word : query.plus_words) {
+            if (contains(expanded_word)) {
+                matched_words.push_back(expanded_word.word);
             }
         }
-
-         }
+    }
+    std::sort(_Exec, matched_words.begin(), matched_words.end());
+    auto it_unique = std::unique(_Exec, matched_words.begin(), matched_words.end());
+    matched_words.erase(it_unique, matched_words.end());
     return { matched_words, documents_.at(document_id).status };
 }
 
@@ -284,10 +463,30 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw
 
 template <typename Execution, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentPredicate document_predicate) const {
+    return SearchServer::FindTopDocuments(_Exec, raw_query, document_predicate, TfIdfScorer{});
+}
+
+template <typename Execution, typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentStatus status, const Scorer& scorer) const {
+    return SearchServer::FindTopDocuments(
+        _Exec, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        }, scorer);
+}
+
+template <typename Execution, typename DocumentPredicate, typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentPredicate document_predicate, const Scorer& scorer) const {
+    return SearchServer::FindTopDocuments(_Exec, raw_query, document_predicate, scorer, NeverStop{});
+}
 
+template <typename Execution, typename DocumentPredicate, typename Scorer, typename StopCondition>
+std::vector<Document> SearchServer::FindTopDocuments(Execution _Exec, const std::string_view& raw_query, DocumentPredicate document_predicate,
+    const Scorer& scorer, StopCondition should_stop) const {
+    std::shared_lock lock(index_mutex_);
     const Query query = ParseQuery(raw_query);
-    std::vector<Document> result = FindAllDocuments(_Exec, query, document_predicate);
+    std::vector<Document> result = FindAllDocuments(_Exec, query, document_predicate, scorer, should_stop);
 
+    PROFILE_PHASE(Phase::TOP_K);
     std::sort(_Exec, result.begin(), result.end(),
         [](const Document& lhs, const Document& rhs) {
             if (std::abs(lhs.relevance - rhs.relevance) < epsilon) {
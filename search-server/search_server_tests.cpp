@@ -0,0 +1,871 @@
+#include "search_server_tests.h"
+#include "search_server.h"
+#include "benchmark.h"
+#include "impact_index.h"
+#include "index_memory.h"
+#include "query_service.h"
+#include "request_queue.h"
+#include "search_cursor.h"
+#include "document_ingestion.h"
+#include "term_index.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+void AssertImpl(bool value, const std::string& expr_str, const std::string& file, unsigned line, const std::string& hint) {
+    if (!value) {
+        std::cerr << file << "("s << line << "): ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            std::cerr << " Hint: "s << hint;
+        }
+        std::cerr << std::endl;
+        std::abort();
+    }
+}
+
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __LINE__, ""s)
+
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __LINE__, (hint))
+
+#define ASSERT_EQUAL(a, b) AssertImpl((a) == (b), #a " == " #b, __FILE__, __LINE__, ""s)
+
+template <typename Exception, typename Function>
+bool Throws(Function function) {
+    try {
+        function();
+    }
+    catch (const Exception&) {
+        return true;
+    }
+    return false;
+}
+
+template <typename Function>
+void RunTestImpl(Function function, const std::string& name) {
+    function();
+    std::cerr << name << " OK"s << std::endl;
+}
+
+#define RUN_TEST(func) RunTestImpl((func), #func)
+
+bool AreSameDocuments(const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (lhs[i].id != rhs[i].id || lhs[i].rating != rhs[i].rating || std::abs(lhs[i].relevance - rhs[i].relevance) >= epsilon) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string GenerateText(std::mt19937& generator, int vocabulary_size, int max_word_count) {
+    std::string text;
+    const int word_count = static_cast<int>(generator() % (max_word_count + 1));
+    for (int i = 0; i < word_count; ++i) {
+        text += "w"s + std::to_string(generator() % vocabulary_size) + " "s;
+    }
+    return text;
+}
+
+void TestUpdateMatchesRemoveAndAdd() {
+    const int document_count = 200;
+    std::mt19937 generator(42);
+    SearchServer updated("w0"s);
+    std::vector<std::string> texts(document_count);
+    std::vector<DocumentStatus> statuses(document_count, DocumentStatus::ACTUAL);
+    std::vector<int> ratings(document_count);
+    for (int id = 0; id < document_count; ++id) {
+        texts[id] = GenerateText(generator, 30, 10);
+        ratings[id] = id % 7;
+        updated.AddDocument(id, texts[id], statuses[id], { ratings[id] });
+    }
+
+    for (int round = 0; round < 300; ++round) {
+        if (round % 3 == 0) {
+            std::vector<DocumentUpdate> updates(4);
+            for (DocumentUpdate& update : updates) {
+                update.document_id = static_cast<int>(generator() % document_count);
+                if (generator() % 2) {
+                    texts[update.document_id] = GenerateText(generator, 30, 10);
+                    update.text = texts[update.document_id];
+                }
+                if (generator() % 2) {
+                    statuses[update.document_id] = static_cast<DocumentStatus>(generator() % 4);
+                    update.status = statuses[update.document_id];
+                }
+                if (generator() % 2) {
+                    ratings[update.document_id] = static_cast<int>(generator() % 10);
+                    update.ratings = std::vector<int>{ ratings[update.document_id] };
+                }
+            }
+            updated.UpdateDocuments(updates);
+        }
+        else {
+            const int id = static_cast<int>(generator() % document_count);
+            texts[id] = GenerateText(generator, 30, 10);
+            statuses[id] = static_cast<DocumentStatus>(generator() % 4);
+            ratings[id] = static_cast<int>(generator() % 10);
+            updated.UpdateDocument(id, texts[id], statuses[id], { ratings[id] });
+        }
+    }
+
+    SearchServer rebuilt("w0"s);
+    for (int id = 0; id < document_count; ++id) {
+        rebuilt.AddDocument(id, texts[id], statuses[id], { ratings[id] });
+    }
+    for (int id = 0; id < document_count; ++id) {
+        ASSERT_HINT(updated.GetWordFrequencies(id) == rebuilt.GetWordFrequencies(id), "document "s + std::to_string(id));
+    }
+    for (int i = 0; i < 100; ++i) {
+        const std::string query = GenerateText(generator, 30, 4) + "-w"s + std::to_string(generator() % 30) + " w1*"s;
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED }) {
+            ASSERT_HINT(AreSameDocuments(updated.FindTopDocuments(query, status), rebuilt.FindTopDocuments(query, status)), query);
+        }
+    }
+}
+
+void TestUpdateRemovesEmptyTerms() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, { 1 });
+
+    search_server.UpdateDocument(1, "cat bird bird"s, DocumentStatus::BANNED, { 5 });
+    ASSERT(search_server.FindTopDocuments("dog"s, DocumentStatus::BANNED).empty());
+    ASSERT(search_server.FindTopDocuments("do*"s, DocumentStatus::BANNED).empty());
+    ASSERT(search_server.FindTopDocuments("dig~1"s, DocumentStatus::BANNED).empty());
+    const std::vector<Document> found = search_server.FindTopDocuments("bird"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(found[0].rating, 5);
+    const SearchServer::WordFrequencies expected = { { "bird"sv, 2.0 / 3 }, { "cat"sv, 1.0 / 3 } };
+    ASSERT(search_server.GetWordFrequencies(1) == expected);
+
+    // Status and rating only: the postings stay as they are
+    search_server.UpdateDocuments({ DocumentUpdate{ 1, std::nullopt, DocumentStatus::ACTUAL, std::vector<int>{ 3 } } });
+    ASSERT(search_server.GetWordFrequencies(1) == expected);
+    ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).at(0).rating, 3);
+}
+
+void TestUpdateDocumentsIsAllOrNothing() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, { 1 });
+
+    ASSERT(Throws<std::invalid_argument>([&] {
+        search_server.UpdateDocuments({ DocumentUpdate{ 1, "bird"s, {}, {} }, DocumentUpdate{ 3, "fish"s, {}, {} } });
+        }));
+    ASSERT(Throws<std::invalid_argument>([&] {
+        search_server.UpdateDocuments({ DocumentUpdate{ 1, "bird"s, {}, {} }, DocumentUpdate{ 2, "fi\x01sh"s, {}, {} } });
+        }));
+    ASSERT(Throws<std::invalid_argument>([&] {
+        search_server.UpdateDocument(3, "bird"s, DocumentStatus::ACTUAL, {});
+        }));
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+    ASSERT(search_server.FindTopDocuments("bird"s).empty());
+
+    search_server.UpdateDocuments({ DocumentUpdate{ 1, "bird"s, {}, {} }, DocumentUpdate{ 2, {}, DocumentStatus::BANNED, {} } });
+    ASSERT(search_server.FindTopDocuments("cat"s).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).size(), 1u);
+    ASSERT(search_server.FindTopDocuments("dog"s).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("dog"s, DocumentStatus::BANNED).size(), 1u);
+}
+
+void TestMinusWordsExcludeDocuments() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(2'000'000'000, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "cat bird"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(7, "cat fish"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(0, "cat dog fish"s, DocumentStatus::ACTUAL, { 1 });
+
+    // The excluded ids are bounded by the minus postings, not by the largest id
+    std::vector<Document> found = search_server.FindTopDocuments("cat -dog"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    ASSERT(found[0].id == 3 || found[1].id == 3);
+    ASSERT(found[0].id == 7 || found[1].id == 7);
+
+    // Documents with several of the minus words are excluded once
+    for (const std::string& query : { "cat -dog -fish"s, "cat -fish -dog -dog -absent"s }) {
+        found = search_server.FindTopDocuments(query);
+        ASSERT_EQUAL(found.size(), 1u);
+        ASSERT_EQUAL(found[0].id, 3);
+        found = search_server.FindTopDocuments(std::execution::par, query);
+        ASSERT_EQUAL(found.size(), 1u);
+        ASSERT_EQUAL(found[0].id, 3);
+    }
+    ASSERT(search_server.FindTopDocuments("cat -cat"s).empty());
+}
+
+void TestTermIndexExpansion() {
+    const std::vector<std::string> terms = { "bat"s, "cart"s, "cat"s, "cats"s, "cut"s, "dog"s, "scat"s };
+    TermIndex term_index;
+    for (const std::string& term : terms) {
+        term_index.Insert(term);
+    }
+
+    ASSERT(term_index.FindByPrefix("ca"s, 10) == std::vector<std::string_view>({ "cart"sv, "cat"sv, "cats"sv }));
+    ASSERT(term_index.FindByPrefix("ca"s, 2) == std::vector<std::string_view>({ "cart"sv, "cat"sv }));
+    ASSERT(term_index.FindByPrefix("x"s, 10).empty());
+    // Closest first, then in lexicographic order
+    ASSERT(term_index.FindFuzzy("cat"s, 1, 10)
+        == std::vector<std::string_view>({ "cat"sv, "bat"sv, "cart"sv, "cats"sv, "cut"sv, "scat"sv }));
+    ASSERT(term_index.FindFuzzy("cat"s, 0, 10) == std::vector<std::string_view>({ "cat"sv }));
+    ASSERT(term_index.FindFuzzy("dgo"s, 2, 10) == std::vector<std::string_view>({ "dog"sv }));
+
+    const size_t node_count = term_index.GetNodeCount();
+    for (int round = 0; round < 10; ++round) {
+        for (const std::string& term : terms) {
+            term_index.Remove(term);
+        }
+        ASSERT_EQUAL(term_index.GetNodeCount(), 1u);
+        for (const std::string& term : terms) {
+            term_index.Insert(term);
+        }
+        ASSERT_EQUAL(term_index.GetNodeCount(), node_count);
+    }
+    term_index.Remove("cat"s);
+    ASSERT(term_index.FindByPrefix("ca"s, 10) == std::vector<std::string_view>({ "cart"sv, "cats"sv }));
+}
+
+void TestMinusWordsAreNotCapped() {
+    SearchServer search_server(""s);
+    search_server.SetMaxTermExpansions(2);
+    search_server.AddDocument(1, "ab x"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(2, "ac x"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(3, "ad x"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(4, "x"s, DocumentStatus::ACTUAL, {});
+    const std::vector<Document> found = search_server.FindTopDocuments("x -a*"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 4);
+    // Plus words are capped
+    ASSERT_EQUAL(search_server.FindTopDocuments("a*"s).size(), 2u);
+}
+
+void TestExpandedMatchesOutliveRemoval() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "computer cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "compute dog"s, DocumentStatus::ACTUAL, { 1 });
+    const std::string query = "comput* cat~1 -bird"s;
+    const auto [words, status] = search_server.MatchDocument(query, 1);
+    const DocumentMatches matches = search_server.MatchDocuments(query, { 1, 2 });
+    search_server.RemoveDocument(1);
+    search_server.RemoveDocument(2);
+    // Words are returned as written and point into the query
+    ASSERT(words == std::vector<std::string_view>({ "cat~1"sv, "comput*"sv }));
+    ASSERT(matches.GetMatchedTerms(0) == words);
+    ASSERT(matches.GetMatchedTerms(1) == std::vector<std::string_view>({ "comput*"sv }));
+}
+
+void TestLiteralWordsWithExpansionSyntax() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "a~b c* cat~1"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cab cod"s, DocumentStatus::ACTUAL, { 1 });
+
+    // Not an edit distance, so the word is looked up as written
+    ASSERT_EQUAL(search_server.FindTopDocuments("a~b"s).size(), 1u);
+    ASSERT(search_server.FindTopDocuments("x~3"s).empty());
+    // Indexed words are not expanded
+    std::vector<Document> found = search_server.FindTopDocuments("c*"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 1);
+    found = search_server.FindTopDocuments("cat~1"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments("co*"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat~"s).size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cab -c*"s).size(), 1u);
+
+    // Matched words point into the query
+    const std::string query = "a~b c* x~3 -cod"s;
+    const auto [words, status] = search_server.MatchDocument(query, 1);
+    ASSERT(words == std::vector<std::string_view>({ "a~b"sv, "c*"sv }));
+    const DocumentMatches matches = search_server.MatchDocuments(query, { 1, 2 });
+    ASSERT(matches.GetMatchedTerms(0) == words);
+    ASSERT(matches.GetMatchedTerms(1).empty());
+}
+
+void TestRankingModels() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat cat bird fish"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "bird"s, DocumentStatus::ACTUAL, { 3 });
+    const auto is_near = [](double lhs, double rhs) {
+        return std::abs(lhs - rhs) < 1e-9;
+    };
+
+    // TF-IDF as before the ranking models: relative term frequency times log(3 / 2)
+    std::vector<Document> found = search_server.FindTopDocuments("cat bird"s);
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 3);
+    ASSERT(is_near(found[0].relevance, 0.405465108108));
+    ASSERT_EQUAL(found[1].id, 2);
+    ASSERT(is_near(found[1].relevance, 0.304098831081));
+    ASSERT_EQUAL(found[2].id, 1);
+    ASSERT(is_near(found[2].relevance, 0.202732554054));
+    ASSERT(AreSameDocuments(found, search_server.FindTopDocuments(std::execution::par, "cat bird"s, DocumentStatus::ACTUAL, TfIdfScorer{})));
+
+    // BM25 with k1 = 1.2, b = 0.75 and the average length 7 / 3, computed by hand
+    found = search_server.FindTopDocuments(std::execution::seq, "cat bird"s, DocumentStatus::ACTUAL, Bm25Scorer{});
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 2);
+    ASSERT(is_near(found[0].relevance, 0.901866820886));
+    ASSERT_EQUAL(found[1].id, 3);
+    ASSERT(is_near(found[1].relevance, 0.613394566982));
+    ASSERT_EQUAL(found[2].id, 1);
+    ASSERT(is_near(found[2].relevance, 0.499176268302));
+
+    // Without length normalization only the term counts matter
+    Bm25Scorer unnormalized;
+    unnormalized.b = 0.0;
+    found = search_server.FindTopDocuments(std::execution::seq, "dog"s, DocumentStatus::ACTUAL, unnormalized);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT(is_near(found[0].relevance, std::log(1.0 + 2.5 / 1.5) * 2.2 / (1.0 + 1.2)));
+}
+
+void TestImpactIndexRejectsChangedServer() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(9, "bird fish"s, DocumentStatus::ACTUAL, { 1 });
+    const ImpactIndex impact_index(search_server);
+    ASSERT_EQUAL(impact_index.FindTopDocuments("fish -dog"s, ImpactIndex::Budget{}).size(), 1u);
+    search_server.RemoveDocument(9);
+    ASSERT(Throws<std::logic_error>([&] {
+        impact_index.FindTopDocuments("fish -dog"s, ImpactIndex::Budget{});
+        }));
+}
+
+void TestImpactIndexRecall() {
+    std::mt19937 generator(11);
+    SearchServer search_server(""s);
+    for (int id = 0; id < 500; ++id) {
+        // "w0" is in every document, so its impact is zero
+        search_server.AddDocument(id, "w0 "s + GenerateText(generator, 50, 12), DocumentStatus::ACTUAL, { static_cast<int>(generator() % 3) });
+    }
+    const ImpactIndex impact_index(search_server);
+    std::vector<std::string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateText(generator, 50, 3) + (i % 5 == 0 ? "-w3 "s : ""s) + (i % 7 == 0 ? "w0"s : ""s));
+    }
+    queries.push_back("w0"s);
+
+    // Without a budget the exact impacts add up to the exhaustive relevances
+    for (const std::string& query : queries) {
+        const std::vector<Document> exact = search_server.FindTopDocuments(query);
+        const std::vector<Document> approximate = impact_index.FindTopDocuments(query, ImpactIndex::Budget{});
+        ASSERT_EQUAL(exact.size(), approximate.size());
+        for (size_t i = 0; i < exact.size(); ++i) {
+            ASSERT_HINT(std::abs(exact[i].relevance - approximate[i].relevance) < epsilon, query);
+            ASSERT_EQUAL(exact[i].rating, approximate[i].rating);
+        }
+    }
+    const ImpactIndex::RecallReport full = impact_index.MeasureRecall(queries, ImpactIndex::Budget{});
+    ASSERT_EQUAL(full.query_count, queries.size());
+    ASSERT(std::abs(full.recall - 1.0) < 1e-12);
+    ASSERT_EQUAL(full.postings_scanned, full.postings_total);
+
+    const ImpactIndex::RecallReport budgeted = impact_index.MeasureRecall(queries, ImpactIndex::Budget{ 20 });
+    ASSERT(budgeted.postings_scanned <= 20 * queries.size());
+    ASSERT(budgeted.postings_scanned < full.postings_scanned);
+    ASSERT(budgeted.recall > 0.0 && budgeted.recall < 1.0);
+}
+
+void TestParseDocumentLine() {
+    ParsedDocument document = ParseDocumentLine("7\tBANNED\t1 -2 3\tcat  dog\t"s, InputFormat::TSV);
+    ASSERT_EQUAL(document.id, 7);
+    ASSERT_EQUAL(document.status, DocumentStatus::BANNED);
+    ASSERT(document.ratings == std::vector<int>({ 1, -2, 3 }));
+    // The text is everything after the third tab
+    ASSERT_EQUAL(document.text, "cat  dog\t"s);
+    document = ParseDocumentLine("8\t2\t\t"s, InputFormat::TSV);
+    ASSERT_EQUAL(document.status, DocumentStatus::BANNED);
+    ASSERT(document.ratings.empty());
+    ASSERT(document.text.empty());
+    for (const std::string& line : { "7\tACTUAL\t1"s, "x\tACTUAL\t1\tcat"s, "7\tOLD\t1\tcat"s, "7\tACTUAL\t1,2\tcat"s, "7 \tACTUAL\t1\tcat"s }) {
+        ASSERT_HINT(Throws<std::invalid_argument>([&] {
+            ParseDocumentLine(line, InputFormat::TSV);
+            }), line);
+    }
+
+    document = ParseDocumentLine(R"({"id": 3, "meta": {"k": [1, {"s": "}"}], "e": {}}, "text": "y\tzA", "tags": ["a", []], "ok": true, "status": "IRRELEVANT", "ratings": [4, -1]})"s,
+        InputFormat::JSONL);
+    ASSERT_EQUAL(document.id, 3);
+    ASSERT_EQUAL(document.status, DocumentStatus::IRRELEVANT);
+    ASSERT(document.ratings == std::vector<int>({ 4, -1 }));
+    ASSERT_EQUAL(document.text, "y\tzA"s);
+    document = ParseDocumentLine(R"( {"status": 3, "id":5,"text":"z", "n": null} )"s, InputFormat::JSONL);
+    ASSERT_EQUAL(document.id, 5);
+    ASSERT_EQUAL(document.status, DocumentStatus::REMOVED);
+    ASSERT_EQUAL(document.text, "z"s);
+    for (const std::string& line : {
+        R"({"id":5,"text":"z"} trailing)"s,
+        R"({"id":5,"text":"z"}})"s,
+        R"({"text":"z"})"s,
+        R"({"id":5,"text":"z")"s,
+        R"({"id":5,"meta":{"k":1,"text":"z"})"s,
+        R"({"id":5,"meta":[1,2,"text":"z"})"s,
+        R"({"id":5,"meta":,"text":"z"})"s,
+        R"({"id":"5","text":"z"})"s,
+        R"({"id":5,"ratings":[1,"2"]})"s,
+        R"({"id":5,"text":"\u00e9"})"s,
+        "{\"id\":5,\"meta\":"s + std::string(100, '[') + std::string(100, ']') + "}"s }) {
+        ASSERT_HINT(Throws<std::invalid_argument>([&] {
+            ParseDocumentLine(line, InputFormat::JSONL);
+            }), line);
+    }
+}
+
+void TestIngestDocuments() {
+    std::istringstream tsv(
+        "1\tACTUAL\t1 2\tcat dog\n"s
+        "2\tBANNED\t\tcat\r\n"s
+        "\n"s
+        "bad line\n"s
+        "1\tACTUAL\t\tduplicate id\n"s
+        "-4\tACTUAL\t\tnegative id\n"s
+        "5\tACTUAL\t\tcontrol \x01 char\n"s
+        "6\tACTUAL\t3\tlast line without newline"s);
+    SearchServer search_server("and"s);
+    IngestionStats stats = IngestDocuments(search_server, tsv, InputFormat::TSV);
+    ASSERT_EQUAL(stats.document_count, 3u);
+    ASSERT_EQUAL(stats.rejected_count, 4u);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("newline"s).at(0).id, 6);
+
+    // More lines than fit in the queues, so the stages have to wait for each other
+    std::ostringstream jsonl;
+    for (int id = 0; id < 20000; ++id) {
+        jsonl << (id % 1000 == 999 ? R"({"id": )"s : R"({"id": )"s + std::to_string(id) + R"(, "x": {"y": [1]}, "text": "w)"s + std::to_string(id % 10) + R"(")"s) << "}\n"s;
+    }
+    std::istringstream jsonl_input(jsonl.str());
+    SearchServer jsonl_server(""s);
+    stats = IngestDocuments(jsonl_server, jsonl_input, InputFormat::JSONL);
+    ASSERT_EQUAL(stats.document_count, 19980u);
+    ASSERT_EQUAL(stats.rejected_count, 20u);
+    ASSERT_EQUAL(stats.byte_count, jsonl.str().size());
+    ASSERT_EQUAL(jsonl_server.GetDocumentCount(), 19980u);
+}
+
+void TestLatencyHistogram() {
+    LatencyHistogram histogram;
+    ASSERT_EQUAL(histogram.GetStats().count, 0u);
+    ASSERT_EQUAL(histogram.GetStats().p50, 0u);
+
+    // Values below 16 have buckets of their own
+    for (uint64_t value = 0; value < 16; ++value) {
+        histogram.Record(value);
+    }
+    PhaseStats stats = histogram.GetStats();
+    ASSERT_EQUAL(stats.count, 16u);
+    ASSERT_EQUAL(stats.total, 120u);
+    ASSERT_EQUAL(stats.max, 15u);
+    ASSERT_EQUAL(stats.p50, 7u);
+    ASSERT_EQUAL(stats.p99, 15u);
+
+    // From 32 on, each power of two has 16 buckets: [48, 50), [50, 52), ..., [96, 100), [100, 104)
+    histogram.Reset();
+    for (uint64_t value = 1; value <= 100; ++value) {
+        histogram.Record(value);
+    }
+    stats = histogram.GetStats();
+    ASSERT_EQUAL(stats.count, 100u);
+    ASSERT_EQUAL(stats.total, 5050u);
+    ASSERT_EQUAL(stats.max, 100u);
+    ASSERT_EQUAL(stats.p50, 50u);
+    ASSERT_EQUAL(stats.p99, 96u);
+    ASSERT_EQUAL(stats.p999, 100u);
+
+    // A percentile is the lower bound of its bucket, at most 1/16 below the value
+    histogram.Reset();
+    histogram.Record(1'000'000);
+    histogram.Record(uint64_t{ 1 } << 63);
+    stats = histogram.GetStats();
+    ASSERT(stats.p50 <= 1'000'000 && stats.p50 > 1'000'000 - 1'000'000 / 16);
+    ASSERT_EQUAL(stats.p999, uint64_t{ 1 } << 63);
+
+    LatencyHistogram other;
+    other.Record(5);
+    histogram.Merge(other);
+    stats = histogram.GetStats();
+    ASSERT_EQUAL(stats.count, 3u);
+    ASSERT_EQUAL(stats.max, uint64_t{ 1 } << 63);
+}
+
+void TestMetricsMergeThreads() {
+    Metrics& metrics = Metrics::Instance();
+    metrics.Reset();
+    std::vector<std::thread> threads;
+    for (uint64_t thread_index = 0; thread_index < 4; ++thread_index) {
+        threads.emplace_back([&metrics, thread_index] {
+            for (uint64_t value = 1; value <= 1000; ++value) {
+                metrics.Record(Phase::TOP_K, value * (thread_index + 1));
+                metrics.Add(Counter::CANDIDATES, 2);
+            }
+            });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    // Values of exited threads are kept
+    MetricsSnapshot snapshot = metrics.GetSnapshot();
+    const PhaseStats& top_k = snapshot.phases[static_cast<size_t>(Phase::TOP_K)];
+    ASSERT_EQUAL(top_k.count, 4000u);
+    ASSERT_EQUAL(top_k.total, 500500u * 10);
+    ASSERT_EQUAL(top_k.max, 4000u);
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(Counter::CANDIDATES)], 8000u);
+
+    metrics.Reset();
+    snapshot = metrics.GetSnapshot();
+    ASSERT_EQUAL(snapshot.phases[static_cast<size_t>(Phase::TOP_K)].count, 0u);
+    ASSERT_EQUAL(snapshot.counters[static_cast<size_t>(Counter::CANDIDATES)], 0u);
+}
+
+void TestFindRegressions() {
+    const std::vector<BenchmarkResult> baseline = {
+        { "steady"s, 1000, 1, 100, 1.0, 5.0 },
+        { "slower"s, 1000, 1, 100, 1.0, 5.0 },
+        { "changed"s, 1000, 1, 100, 1.0, 5.0 },
+        { "threads"s, 1000, 1, 100, 1.0, 5.0 },
+    };
+    // Survives a round trip through the CSV
+    std::stringstream csv;
+    WriteBenchmarkResults(csv, baseline);
+    const std::vector<BenchmarkResult> read_baseline = ReadBenchmarkResults(csv);
+    ASSERT_EQUAL(read_baseline.size(), baseline.size());
+    ASSERT_EQUAL(read_baseline[1].name, "slower"s);
+    ASSERT_EQUAL(read_baseline[1].operation_count, 100u);
+
+    const std::vector<BenchmarkResult> current = {
+        // Within the tolerance, and faster
+        { "steady"s, 1000, 1, 100, 1.1, 5.0 },
+        { "slower"s, 1000, 1, 100, 1.3, 5.0 },
+        // Reported as changed even though it is also slower
+        { "changed"s, 1000, 1, 100, 2.0, 5.5 },
+        // Thread count and corpus size the baseline has no row of
+        { "threads"s, 1000, 4, 100, 9.0, 1.0 },
+        { "steady"s, 2000, 1, 100, 9.0, 1.0 },
+        { "added"s, 1000, 1, 100, 1.0, 1.0 },
+        { "added"s, 2000, 1, 100, 1.0, 1.0 },
+    };
+    const std::vector<BenchmarkRegression> regressions = FindRegressions(read_baseline, current, 0.2);
+    ASSERT_EQUAL(regressions.size(), 3u);
+    ASSERT_EQUAL(regressions[0].current.name, "slower"s);
+    ASSERT_EQUAL(regressions[0].reason, "slower"s);
+    ASSERT_EQUAL(regressions[1].current.name, "changed"s);
+    ASSERT_EQUAL(regressions[1].reason, "checksum changed"s);
+    ASSERT_EQUAL(regressions[2].current.name, "added"s);
+    ASSERT_EQUAL(regressions[2].current.corpus_size, 1000u);
+    ASSERT_EQUAL(regressions[2].reason, "missing from baseline"s);
+
+    ASSERT(FindRegressions(read_baseline, current, 0.5).size() == 2u);
+    ASSERT(Throws<std::invalid_argument>([] {
+        std::istringstream input("name,corpus_size\nbroken,1000\n"s);
+        ReadBenchmarkResults(input);
+        }));
+}
+
+void TestMatchDocumentsAgreesWithMatchDocument() {
+    const int document_count = 2000;
+    std::mt19937 generator(7);
+    SearchServer search_server("w0"s);
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, GenerateText(generator, 40, 8), static_cast<DocumentStatus>(generator() % 4), { 1 });
+    }
+    // Many requested ids merge with the postings, few are probed
+    std::vector<int> many_ids;
+    for (int id = document_count - 1; id >= 0; id -= 3) {
+        many_ids.push_back(id);
+    }
+    std::vector<int> few_ids = { 17, 5, 1999 };
+
+    for (int i = 0; i < 100; ++i) {
+        std::string query;
+        for (int j = 0; j < 4; ++j) {
+            query += (generator() % 4 == 0 ? "-"s : ""s) + "w"s + std::to_string(generator() % 40);
+            query += generator() % 5 == 0 ? "* "s : generator() % 5 == 0 ? "~1 "s : " "s;
+        }
+        for (const std::vector<int>* ids : { &many_ids, &few_ids }) {
+            const DocumentMatches matches = search_server.MatchDocuments(query, *ids);
+            for (size_t position = 0; position < ids->size(); ++position) {
+                const auto [words, status] = search_server.MatchDocument(query, (*ids)[position]);
+                const auto [par_words, par_status] = search_server.MatchDocument(std::execution::par, query, (*ids)[position]);
+                ASSERT_HINT(words == matches.GetMatchedTerms(position), query);
+                ASSERT_HINT(words == par_words, query);
+                ASSERT_EQUAL(status, matches.statuses[position]);
+            }
+        }
+    }
+}
+
+// Message of the QueryCancelled the handle's Get throws, empty if it returns
+std::string GetCancelReason(QueryHandle& handle) {
+    try {
+        handle.Get();
+    }
+    catch (const QueryCancelled& error) {
+        return error.what();
+    }
+    return ""s;
+}
+
+void TestQueryServiceStopsQueries() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::BANNED, { 1 });
+
+    QueryService service(search_server, 1);
+    service.Pause();
+    QueryHandle cancelled = service.Submit("cat"s);
+    QueryHandle expired = service.Submit("dog"s, DocumentStatus::ACTUAL, std::chrono::milliseconds(1));
+    // Shares its search with a cancelled query and still gets the result
+    QueryHandle shared = service.Submit("cat"s);
+    QueryHandle other_status = service.Submit("cat"s, DocumentStatus::BANNED);
+    cancelled.Cancel();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    service.Resume();
+
+    ASSERT_EQUAL(GetCancelReason(cancelled), "Query cancelled"s);
+    ASSERT_EQUAL(GetCancelReason(expired), "Query deadline exceeded"s);
+    const std::vector<Document> shared_found = shared.Get();
+    ASSERT_EQUAL(shared_found.size(), 1u);
+    ASSERT_EQUAL(shared_found[0].id, 1);
+    const std::vector<Document> banned_found = other_status.Get();
+    ASSERT_EQUAL(banned_found.size(), 1u);
+    ASSERT_EQUAL(banned_found[0].id, 2);
+    // Nothing is searched for the expired query
+    ASSERT_EQUAL(service.GetSearchCount(), 2u);
+}
+
+void TestQueryServiceSharesIdenticalQueries() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, { 2 });
+
+    QueryService service(search_server, 1, 16);
+    service.Pause();
+    std::vector<QueryHandle> handles;
+    for (int i = 0; i < 4; ++i) {
+        handles.push_back(service.Submit("cat"s));
+    }
+    handles.push_back(service.Submit("bird"s));
+    service.Resume();
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQUAL(handles[i].Get().size(), 2u);
+    }
+    ASSERT_EQUAL(handles[4].Get().size(), 1u);
+    ASSERT_EQUAL(service.GetSearchCount(), 2u);
+}
+
+void TestQueryServiceFailsQueuedQueries() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    std::optional<QueryService> service(std::in_place, search_server, 2);
+    service->Pause();
+    QueryHandle handle = service->Submit("cat"s);
+    service.reset();
+    ASSERT_EQUAL(GetCancelReason(handle), "Query service stopped"s);
+}
+
+void TestRequestQueueWindow() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    RequestQueue request_queue(search_server);
+    for (int i = 0; i < 1440; ++i) {
+        request_queue.AddFindRequest("bird"s);
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1440);
+    // Pushes the oldest empty request out of the day
+    request_queue.AddFindRequest("cat"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    for (int i = 1; i < 1440; ++i) {
+        request_queue.AddFindRequest("cat"s);
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    request_queue.AddFindRequest("bird"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+}
+
+void TestSearchCursor() {
+    std::mt19937 generator(3);
+    SearchServer search_server("w0"s);
+    for (int id = 0; id < 1000; ++id) {
+        search_server.AddDocument(id, GenerateText(generator, 30, 6), DocumentStatus::ACTUAL, { static_cast<int>(generator() % 5) });
+    }
+    const std::string query = "w1 w2 w3* -w4"s;
+
+    auto cursor = OpenSearchCursor(search_server, query, 7);
+    std::vector<Document> documents;
+    std::set<int> ids;
+    for (const auto page : Paginate(cursor)) {
+        for (const Document& document : page) {
+            documents.push_back(document);
+            ids.insert(document.id);
+        }
+    }
+    ASSERT(cursor.IsExhausted());
+    ASSERT_EQUAL(ids.size(), documents.size());
+    // The same documents in the same order as a single page
+    auto single_page_cursor = OpenSearchCursor(search_server, query, documents.size());
+    const std::vector<Document> single_page = single_page_cursor.NextPage();
+    ASSERT(single_page_cursor.IsExhausted());
+    ASSERT(single_page_cursor.NextPage().empty());
+    ASSERT_EQUAL(single_page.size(), documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ASSERT_EQUAL(single_page[i].id, documents[i].id);
+    }
+    // FindTopDocuments leaves the order of full ties unspecified, so only the ranks are compared
+    const std::vector<Document> top = search_server.FindTopDocuments(query);
+    ASSERT(documents.size() >= top.size());
+    for (size_t i = 0; i < top.size(); ++i) {
+        ASSERT(std::abs(top[i].relevance - documents[i].relevance) < epsilon);
+        ASSERT_EQUAL(top[i].rating, documents[i].rating);
+    }
+
+    auto changed_cursor = OpenSearchCursor(search_server, query, 7);
+    changed_cursor.NextPage();
+    search_server.RemoveDocument(documents.back().id);
+    ASSERT(Throws<std::logic_error>([&] {
+        changed_cursor.NextPage();
+        }));
+    ASSERT(Throws<std::invalid_argument>([&] {
+        OpenSearchCursor(search_server, "w1 --w2"s, 7);
+        }));
+}
+
+// Allocates from new/delete and counts the bytes in use
+class CountingMemoryResource : public std::pmr::memory_resource {
+public:
+    size_t used_bytes = 0;
+    size_t allocation_count = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        used_bytes += bytes;
+        ++allocation_count;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+        used_bytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+void TestServerUsesGivenMemoryResource() {
+    IndexMemoryResource& index_memory = IndexMemoryResource::Instance();
+    const size_t index_allocation_count = index_memory.GetStats().allocation_count;
+    CountingMemoryResource memory;
+    {
+        SearchServer search_server("and"s, &memory);
+        search_server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocument(2, "cat and bird"s, DocumentStatus::ACTUAL, { 2 });
+        search_server.UpdateDocument(2, "fish"s, DocumentStatus::ACTUAL, { 2 });
+        ASSERT(memory.used_bytes > 0);
+        ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+        search_server.RemoveDocument(1);
+    }
+    ASSERT(memory.allocation_count > 0);
+    ASSERT_EQUAL(memory.used_bytes, 0u);
+    ASSERT_EQUAL(index_memory.GetStats().allocation_count, index_allocation_count);
+}
+
+void TestIndexMemoryReusesBlocks() {
+    IndexMemoryResource& memory = IndexMemoryResource::Instance();
+    // Every server of the earlier tests is gone
+    ASSERT_EQUAL(memory.GetStats().used_bytes, 0u);
+    const size_t size = 48;
+
+    // Freeing the last block refills the chunks, so blocks come from the
+    // start of the first chunk again
+    memory.deallocate(memory.allocate(size), size);
+    void* const first = memory.allocate(size);
+    memory.deallocate(first, size);
+    void* const again = memory.allocate(size);
+    ASSERT(again == first);
+
+    // A reset stopped by a block in use keeps the blocks cached by the thread
+    void* const freed = memory.allocate(size);
+    memory.deallocate(freed, size);
+    ASSERT(!memory.TryReset());
+    void* const reused = memory.allocate(size);
+    ASSERT(reused == freed);
+    memory.deallocate(reused, size);
+    memory.deallocate(again, size);
+    ASSERT_EQUAL(memory.GetStats().used_bytes, 0u);
+}
+
+void TestIndexMemoryFallbackStats() {
+    IndexMemoryResource& memory = IndexMemoryResource::Instance();
+    const IndexMemoryConfig saved_config = memory.GetConfig();
+    memory.Configure({ true, MemoryPlacement::INTERLEAVE, 0 });
+    const IndexMemoryStats before = memory.GetStats();
+    // Blocks of the largest size class until a chunk is mapped
+    const size_t size = 256;
+    std::vector<void*> blocks;
+    while (memory.GetStats().chunk_count == before.chunk_count) {
+        blocks.push_back(memory.allocate(size));
+    }
+    const IndexMemoryStats after = memory.GetStats();
+    for (void* block : blocks) {
+        memory.deallocate(block, size);
+    }
+    memory.Configure(saved_config);
+
+    ASSERT_EQUAL(after.chunk_count, before.chunk_count + 1);
+    ASSERT_EQUAL(after.mapped_bytes, before.mapped_bytes + IndexMemoryResource::CHUNK_SIZE);
+    // Each request is either met or counted as a fallback
+    ASSERT_EQUAL(after.huge_page_chunk_count + after.huge_page_fallback_count,
+        before.huge_page_chunk_count + before.huge_page_fallback_count + 1);
+    ASSERT_EQUAL(after.placed_chunk_count + after.placement_fallback_count,
+        before.placed_chunk_count + before.placement_fallback_count + 1);
+    ASSERT_EQUAL(after.allocation_count, before.allocation_count + blocks.size());
+    ASSERT_EQUAL(memory.GetStats().used_bytes, 0u);
+}
+
+}  // namespace
+
+void TestSearchServer() {
+    RUN_TEST(TestUpdateMatchesRemoveAndAdd);
+    RUN_TEST(TestUpdateRemovesEmptyTerms);
+    RUN_TEST(TestUpdateDocumentsIsAllOrNothing);
+    RUN_TEST(TestMinusWordsExcludeDocuments);
+    RUN_TEST(TestTermIndexExpansion);
+    RUN_TEST(TestMinusWordsAreNotCapped);
+    RUN_TEST(TestExpandedMatchesOutliveRemoval);
+    RUN_TEST(TestLiteralWordsWithExpansionSyntax);
+    RUN_TEST(TestRankingModels);
+    RUN_TEST(TestImpactIndexRecall);
+    RUN_TEST(TestImpactIndexRejectsChangedServer);
+    RUN_TEST(TestParseDocumentLine);
+    RUN_TEST(TestIngestDocuments);
+    RUN_TEST(TestLatencyHistogram);
+    RUN_TEST(TestMetricsMergeThreads);
+    RUN_TEST(TestFindRegressions);
+    RUN_TEST(TestMatchDocumentsAgreesWithMatchDocument);
+    RUN_TEST(TestQueryServiceStopsQueries);
+    RUN_TEST(TestQueryServiceSharesIdenticalQueries);
+    RUN_TEST(TestQueryServiceFailsQueuedQueries);
+    RUN_TEST(TestRequestQueueWindow);
+    RUN_TEST(TestSearchCursor);
+    RUN_TEST(TestServerUsesGivenMemoryResource);
+    RUN_TEST(TestIndexMemoryReusesBlocks);
+    RUN_TEST(TestIndexMemoryFallbackStats);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Behaviour checks of the index, run by main.cpp before the benchmarks.
+// A failed check prints its location and aborts.
+void TestSearchServer();
@@ -0,0 +1,171 @@
+#include "term_index.h"
+#include <algorithm>
+
+TermIndex::TermIndex()
+    : nodes_(1) {
+}
+
+void TermIndex::Insert(const std::string& term) {
+    uint32_t node = 0;
+    for (const char c : term) {
+        auto& edges = nodes_[node].edges;
+        auto it = std::lower_bound(edges.begin(), edges.end(), c, [](const Edge& edge, char label) {
+            return edge.label < label;
+            });
+        if (it != edges.end() && it->label == c) {
+            node = it->target;
+            continue;
+        }
+        const size_t position = it - edges.begin();
+        // AllocateNode may reallocate nodes_ and invalidate edges
+        const uint32_t child = AllocateNode();
+        auto& parent_edges = nodes_[node].edges;
+        parent_edges.insert(parent_edges.begin() + position, { c, child });
+        node = child;
+    }
+    nodes_[node].term = &term;
+}
+
+void TermIndex::Remove(std::string_view term) {
+    // Nodes on the path of term, the root first
+    std::vector<uint32_t> path = { 0 };
+    for (const char c : term) {
+        const uint32_t child = FindChild(path.back(), c);
+        if (child == 0) {
+            return;
+        }
+        path.push_back(child);
+    }
+    nodes_[path.back()].term = nullptr;
+
+    // Frees the nodes that no longer lead to a term, from the leaf up
+    for (size_t depth = term.size(); depth > 0; --depth) {
+        Node& node = nodes_[path[depth]];
+        if (node.term != nullptr || !node.edges.empty()) {
+            break;
+        }
+        auto& parent_edges = nodes_[path[depth - 1]].edges;
+        parent_edges.erase(std::lower_bound(parent_edges.begin(), parent_edges.end(), term[depth - 1], [](const Edge& edge, char label) {
+            return edge.label < label;
+            }));
+        node.edges = std::vector<Edge>();
+        free_nodes_.push_back(path[depth]);
+    }
+}
+
+size_t TermIndex::GetNodeCount() const {
+    return nodes_.size() - free_nodes_.size();
+}
+
+uint32_t TermIndex::AllocateNode() {
+    if (!free_nodes_.empty()) {
+        const uint32_t node = free_nodes_.back();
+        free_nodes_.pop_back();
+        return node;
+    }
+    nodes_.emplace_back();
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+std::vector<std::string_view> TermIndex::FindByPrefix(std::string_view prefix, size_t max_count) const {
+    std::vector<std::string_view> result;
+    const uint32_t node = FindNode(prefix);
+    if (node == 0 && !prefix.empty()) {
+        return result;
+    }
+    CollectTerms(node, max_count, result);
+    return result;
+}
+
+std::vector<std::string_view> TermIndex::FindFuzzy(std::string_view word, int max_distance, size_t max_count) const {
+    // Row i of the Levenshtein matrix for the empty trie path
+    std::vector<int> first_row(word.size() + 1);
+    for (size_t i = 0; i < first_row.size(); ++i) {
+        first_row[i] = static_cast<int>(i);
+    }
+
+    std::vector<FuzzyMatch> matches;
+    if (nodes_[0].term != nullptr && first_row.back() <= max_distance) {
+        matches.push_back({ first_row.back(), *nodes_[0].term });
+    }
+    for (const Edge& edge : nodes_[0].edges) {
+        CollectFuzzy(edge.target, edge.label, word, max_distance, first_row, matches);
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const FuzzyMatch& lhs, const FuzzyMatch& rhs) {
+        if (lhs.distance != rhs.distance) {
+            return lhs.distance < rhs.distance;
+        }
+        return lhs.term < rhs.term;
+        });
+    if (matches.size() > max_count) {
+        matches.resize(max_count);
+    }
+
+    std::vector<std::string_view> result;
+    result.reserve(matches.size());
+    for (const FuzzyMatch& match : matches) {
+        result.push_back(match.term);
+    }
+    return result;
+}
+
+uint32_t TermIndex::FindChild(uint32_t node, char label) const {
+    const auto& edges = nodes_[node].edges;
+    auto it = std::lower_bound(edges.begin(), edges.end(), label, [](const Edge& edge, char c) {
+        return edge.label < c;
+        });
+    if (it == edges.end() || it->label != label) {
+        return 0;
+    }
+    return it->target;
+}
+
+uint32_t TermIndex::FindNode(std::string_view path) const {
+    uint32_t node = 0;
+    for (const char c : path) {
+        node = FindChild(node, c);
+        if (node == 0) {
+            return 0;
+        }
+    }
+    return node;
+}
+
+void TermIndex::CollectTerms(uint32_t node, size_t max_count, std::vector<std::string_view>& result) const {
+    if (result.size() >= max_count) {
+        return;
+    }
+    if (nodes_[node].term != nullptr) {
+        result.push_back(*nodes_[node].term);
+    }
+    for (const Edge& edge : nodes_[node].edges) {
+        CollectTerms(edge.target, max_count, result);
+        if (result.size() >= max_count) {
+            return;
+        }
+    }
+}
+
+void TermIndex::CollectFuzzy(uint32_t node, char label, std::string_view word, int max_distance,
+    const std::vector<int>& previous_row, std::vector<FuzzyMatch>& result) const {
+    // One step of the Levenshtein automaton: the row for the trie path
+    // extended by label, computed from the row of its parent
+    std::vector<int> row(previous_row.size());
+    row[0] = previous_row[0] + 1;
+    for (size_t i = 1; i < row.size(); ++i) {
+        const int substitution = previous_row[i - 1] + (word[i - 1] == label ? 0 : 1);
+        row[i] = std::min({ row[i - 1] + 1, previous_row[i] + 1, substitution });
+    }
+
+    if (nodes_[node].term != nullptr && row.back() <= max_distance) {
+        result.push_back({ row.back(), *nodes_[node].term });
+    }
+    // No extension of this path can get back within max_distance
+    if (*std::min_element(row.begin(), row.end()) > max_distance) {
+        return;
+    }
+    for (const Edge& edge : nodes_[node].edges) {
+        CollectFuzzy(edge.target, edge.label, word, max_distance, row, result);
+    }
+}
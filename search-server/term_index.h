@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Trie over the term dictionary of the search server. Nodes live in one
+// vector and keep their outgoing edges sorted by label, so terms are
+// enumerated in lexicographic order. This is a plain trie with an edge vector
+// per node, not an FST or a double-array trie: terms come and go with
+// documents, and both of those are built for static dictionaries. Nodes left
+// without terms by Remove are reused by later inserts.
+// Terms are not copied: the index stores pointers to strings owned by the
+// caller, which must outlive their entries.
+class TermIndex {
+public:
+    TermIndex();
+
+    void Insert(const std::string& term);
+
+    void Remove(std::string_view term);
+
+    // Nodes in use, the root included
+    size_t GetNodeCount() const;
+
+    // Terms starting with prefix, in lexicographic order
+    std::vector<std::string_view> FindByPrefix(std::string_view prefix, size_t max_count) const;
+
+    // Terms within max_distance Levenshtein edits of word, closest first
+    std::vector<std::string_view> FindFuzzy(std::string_view word, int max_distance, size_t max_count) const;
+
+private:
+    struct Edge {
+        char label;
+        uint32_t target;
+    };
+
+    struct Node {
+        std::vector<Edge> edges;
+        const std::string* term = nullptr;
+    };
+
+    struct FuzzyMatch {
+        int distance;
+        std::string_view term;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+
+    uint32_t AllocateNode();
+
+    // Returns 0 (the root) when there is no such edge
+    uint32_t FindChild(uint32_t node, char label) const;
+
+    uint32_t FindNode(std::string_view path) const;
+
+    void CollectTerms(uint32_t node, size_t max_count, std::vector<std::string_view>& result) const;
+
+    void CollectFuzzy(uint32_t node, char label, std::string_view word, int max_distance,
+        const std::vector<int>& previous_row, std::vector<FuzzyMatch>& result) const;
+};